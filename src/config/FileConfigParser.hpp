@@ -23,6 +23,8 @@
 #include "lepp3/util/OfflineVideoSource.hpp"
 
 #include "lola/PoseService.h"
+#include "lola/ShmRobotService.h"
+#include "lola/UdpRobotService.h"
 
 /**
  * A `Parser` implementation that reads the configuration from a config file
@@ -125,13 +127,43 @@ protected:
   }
 
   // constructs a RobotService from the parameters specified by t
-  boost::shared_ptr<AsyncRobotService> getRobotService(const toml::Value& v) {
-    std::string const target = getTomlValue<std::string>(v, "target", "aggregators[RobotAggregator].");
+  boost::shared_ptr<RobotService> getRobotService(const toml::Value& v) {
+    std::string const transport = getOptionalTomlValue<std::string>(v, "transport", "tcp");
+    if (transport == "shm") {
+      std::string const name = getOptionalTomlValue<std::string>(v, "shm_name", "/lepp3_vision");
+      int const size = getOptionalTomlValue(v, "shm_size", (int)(ShmRobotService::DEFAULT_CAPACITY >> 20));
+      int const keyframe_interval = getOptionalTomlValue(v, "keyframe_interval", (int)ShmRobotService::DEFAULT_KEYFRAME_INTERVAL);
+
+      boost::shared_ptr<ShmRobotService> shm_robot_service(new ShmRobotService(name, (uint64_t)size << 20, keyframe_interval));
+      shm_robot_service->start();
+      return shm_robot_service;
+    }
+
     std::string const ip = getTomlValue<std::string>(v, "ip", "aggregators[RobotAggregator].");
     int const port = getTomlValue<int>(v, "port", "aggregators[RobotAggregator].");
+    if (transport == "udp") {
+      int const keyframe_interval = getOptionalTomlValue(v, "keyframe_interval", (int)UdpRobotService::DEFAULT_KEYFRAME_INTERVAL);
+      int const datagram_size = getOptionalTomlValue(v, "datagram_size", (int)UdpRobotService::DEFAULT_DATAGRAM_SIZE);
+      int const ttl = getOptionalTomlValue(v, "ttl", 1);
+
+      boost::shared_ptr<UdpRobotService> udp_robot_service(new UdpRobotService(ip, port, keyframe_interval, datagram_size, ttl));
+      udp_robot_service->start();
+      return udp_robot_service;
+    } else if (transport != "tcp") {
+      throw std::runtime_error("aggregators[RobotAggregator].transport must be \"tcp\", \"udp\" or \"shm\"");
+    }
+
+    std::string const target = getTomlValue<std::string>(v, "target", "aggregators[RobotAggregator].");
     int const delay = getOptionalTomlValue(v, "delay", 0);
+    int const burst = getOptionalTomlValue(v, "burst", AsyncRobotService::DEFAULT_BURST);
+    if (burst <= 0) {
+      throw std::runtime_error("aggregators[RobotAggregator].burst must be positive");
+    }
+    int const protocol = getOptionalTomlValue(v, "protocol", (int)am2b_iface::VISION_PROTOCOL_V2);
+    int const queue_size = getOptionalTomlValue(v, "queue_size", (int)AsyncRobotService::DEFAULT_QUEUE_SIZE);
 
-    boost::shared_ptr<AsyncRobotService> async_robot_service(new AsyncRobotService(ip, target, port, delay));
+    boost::shared_ptr<AsyncRobotService> async_robot_service(
+        new AsyncRobotService(ip, target, port, delay, burst, protocol, queue_size));
     async_robot_service->start();
     return async_robot_service;
   }
@@ -286,7 +318,8 @@ protected:
   void initPoseService() {
     std::string ip = getTomlValue<std::string>(toml_tree_, "PoseService.ip");
     int port = getTomlValue<int>(toml_tree_, "PoseService.port");
-    this->pose_service_ = PoseServiceFromUdp(ip, port);
+    int latency = getOptionalTomlValue(toml_tree_, "PoseService.latency", 0);
+    this->pose_service_ = PoseServiceFromUdp(ip, port, latency);
   }
 
   void addObservers() {
@@ -420,6 +453,11 @@ protected:
           double cylinder = getTomlValue<double>(v, "cylinder", base_key_condition);
           split_strat->addSplitCondition(std::make_shared<ShapeSplitCondition>(sphere1, sphere2, cylinder));
 
+        } else if (type == "FitError") {
+          double voxel_size = getTomlValue<double>(v, "voxel_size", base_key_condition);
+          double max_error = getTomlValue<double>(v, "max_error", base_key_condition);
+          split_strat->addSplitCondition(std::make_shared<FitErrorSplitCondition>(voxel_size, max_error));
+
         } else {
           std::ostringstream ss;
           ss << "Unknown split condition: " << type;
@@ -462,8 +500,8 @@ protected:
     std::string segment_method = getTomlValue<std::string>(*segmenter, "method", "ObstacleDetection.Segmenter");
     std::cout << "Initializing obstacle detector with segmentation method: " << segment_method << std::endl;
     if ("Euclidean" == segment_method) {
-      double min_filter_percentage = getOptionalTomlValue(*segmenter, "min_filter_percentage", 0.9);
-      base_obstacle_segmenter_.reset(new EuclideanSegmenter(min_filter_percentage));
+      auto params = readEuclideanSegmenterParameters(*segmenter);
+      base_obstacle_segmenter_.reset(new EuclideanSegmenter(params));
     } else if ("GMM" == segment_method) {
         /// TODO: Check for kalman params
       auto params = readGmmSegmenterParameters(*segmenter);
@@ -500,9 +538,12 @@ protected:
       if (tracker_type == "LowPassFilter")
       {
         std::cout << "Adding low-pass obstacle tracker" << std::endl;
-        /// TODO: low-pass filter has some params we should expose to cfg files
+        LowPassObstacleTracker::Parameters params;
+        params.LOST_LIMIT = getOptionalTomlValue(*tracker, "lostLimit", params.LOST_LIMIT);
+        params.FOUND_LIMIT = getOptionalTomlValue(*tracker, "foundLimit", params.FOUND_LIMIT);
+        params.MAX_CENTER_DISTANCE = getOptionalTomlValue(*tracker, "maxCenterDistance", params.MAX_CENTER_DISTANCE);
         boost::shared_ptr<LowPassObstacleTracker> low_pass_obstacle_tracker(
-            new LowPassObstacleTracker);
+            new LowPassObstacleTracker(params));
 
         approx->FrameDataSubject::attachObserver(low_pass_obstacle_tracker);
 
@@ -660,6 +701,28 @@ private:
     return params;
   }
 
+  /**
+   * A helper function that reads the (optional) parameters of the
+   * `EuclideanSegmenter`.
+   */
+  EuclideanSegmenter::Parameters readEuclideanSegmenterParameters(toml::Value const& v) {
+    EuclideanSegmenter::Parameters params;
+    params.clusterTolerance = getOptionalTomlValue(v, "cluster_tolerance", params.clusterTolerance);
+    params.toleranceRangeFactor = getOptionalTomlValue(v, "tolerance_range_factor", params.toleranceRangeFactor);
+    params.minClusterSize = getOptionalTomlValue(v, "min_cluster_size", params.minClusterSize);
+    params.maxClusterSize = getOptionalTomlValue(v, "max_cluster_size", params.maxClusterSize);
+    if (params.clusterTolerance <= 0) {
+      throw std::runtime_error("ObstacleDetection.Segmenter.cluster_tolerance must be positive");
+    }
+    if (params.toleranceRangeFactor < 0) {
+      throw std::runtime_error("ObstacleDetection.Segmenter.tolerance_range_factor must not be negative");
+    }
+    if (params.minClusterSize > params.maxClusterSize) {
+      throw std::runtime_error("ObstacleDetection.Segmenter.min_cluster_size must not exceed max_cluster_size");
+    }
+    return params;
+  }
+
   /**
    * A helper function that reads all the parameters that are required by the
    * `GMMObstacleTracker`.
@@ -678,6 +741,7 @@ private:
     params.numSplitFrames = getOptionalTomlValue(v, "num_split_frames", 6);
     params.splitMaxOtherStatesPercentage = getOptionalTomlValue(v, "split_max_other_states_percentage", 0.2);
     params.obsCovarRegularization = getOptionalTomlValue(v, "obs_covar_regularization", 0.95);
+    params.emSubsampleSize = getOptionalTomlValue(v, "em_subsample_size", 0);
     params.minPersistentFrames = getOptionalTomlValue(v, "min_persistent_frames", 1);
     params.obstacleDensity = getOptionalTomlValue(v, "obstacle_density", 0.0);
     params.enableKalmanFilter = getOptionalTomlValue(v, "enable_kalman_filter", false);
@@ -880,6 +944,24 @@ private:
         min_surface_height = getOptionalTomlValue<double>(v, "min_surface_height", 0);
         surface_normal_tolerance = getOptionalTomlValue<double>(v, "surface_normal_tolerance", 0);
       }
+      PointCloudEncoding pointcloud_encoding;
+      if (std::find(datatypes.begin(), datatypes.end(), "pointclouds") != datatypes.end())
+      {
+        pointcloud_encoding.compress = getOptionalTomlValue(v, "pointcloud_compression", pointcloud_encoding.compress);
+        pointcloud_encoding.resolution = getOptionalTomlValue<double>(v, "pointcloud_resolution", pointcloud_encoding.resolution);
+        pointcloud_encoding.voxel_size = getOptionalTomlValue<double>(v, "pointcloud_voxel_size", pointcloud_encoding.voxel_size);
+        if (pointcloud_encoding.resolution <= 0) {
+          throw std::runtime_error("aggregators.pointcloud_resolution must be positive");
+        }
+      }
+      ObstacleChangeTolerance obstacle_tolerance;
+      if (std::find(datatypes.begin(), datatypes.end(), "obstacles") != datatypes.end())
+      {
+        obstacle_tolerance.center = getOptionalTomlValue<double>(v, "obstacle_center_tolerance", obstacle_tolerance.center);
+        obstacle_tolerance.endpoint = getOptionalTomlValue<double>(v, "obstacle_endpoint_tolerance", obstacle_tolerance.endpoint);
+        obstacle_tolerance.radius = getOptionalTomlValue<double>(v, "obstacle_radius_tolerance", obstacle_tolerance.radius);
+        obstacle_tolerance.min_interval = getOptionalTomlValue<int>(v, "obstacle_min_interval", obstacle_tolerance.min_interval);
+      }
       auto robotService = getRobotService(v);
 
       // attach to RGB data here since we always assume we're dealing with FrameDataObservers elsewhere...
@@ -888,7 +970,9 @@ private:
                                                                                                datatypes,
                                                                                                *this->robot(),
                                                                                                min_surface_height,
-                                                                                               surface_normal_tolerance);
+                                                                                               surface_normal_tolerance,
+                                                                                               pointcloud_encoding,
+                                                                                               obstacle_tolerance);
       boost::static_pointer_cast<RGBDataSubject>(this->raw_source_)->attachObserver(robotAggregator);
       return robotAggregator;
 
@@ -2,16 +2,42 @@
 #define LEPP3_DIFF_AGGREGATOR_H__
 
 #include "lepp3/FrameData.hpp"
+#include "lepp3/util/FlatIdMap.hpp"
 
-#include <set>
+#include <cmath>
 #include <vector>
-#include <algorithm>
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 
 namespace lepp {
 
+/**
+ * How much an obstacle needs to change before the `DiffAggregator` reports it
+ * as modified. An obstacle is modified if any of its primitives moved or
+ * changed its radius by more than the given tolerances (in meters), or if the
+ * number or types of its primitives changed.
+ */
+struct ObstacleChangeTolerance {
+  /**
+   * Maximum displacement of the center of a sphere.
+   */
+  double center = 0;
+  /**
+   * Maximum displacement of either endpoint of a capsule.
+   */
+  double endpoint = 0;
+  /**
+   * Maximum change of the radius of a primitive.
+   */
+  double radius = 0;
+  /**
+   * Minimum number of frames between two modifications reported for the same
+   * obstacle. Changes within this interval are reported once it elapsed.
+   */
+  long min_interval = 0;
+};
+
 /**
  * An implementation of an `FrameDataObserver` that finds diffs between
  * obstacles detected in subsequent snapshots.
@@ -22,6 +48,9 @@ namespace lepp {
  * For each difference between the previous snapshot and the current one,
  * the appropriate callback is fired, if provided, so that the client can
  * take appropriate actions if a diff is detected.
+ *
+ * Obstacles found in both snapshots are only reported as modified if they
+ * changed beyond the `ObstacleChangeTolerance` since they were last reported.
  */
 class DiffAggregator : public FrameDataObserver {
 public:
@@ -39,8 +68,8 @@ public:
    * Create a new `DiffAggregator` that will output the diff between frames
    * after every `frequency` frames.
    */
-  DiffAggregator(int frequency)
-      : freq_(frequency), new_obstacle_cb_(0), mod_obstacle_cb_(0), del_obstacle_cb_(0), new_surface_cb_(0), mod_surface_cb_(0), del_surface_cb_(0) {}
+  DiffAggregator(int frequency, ObstacleChangeTolerance const& tolerance = ObstacleChangeTolerance())
+      : freq_(frequency), tolerance_(tolerance), curr_(0), snapshot_(0), new_obstacle_cb_(0), mod_obstacle_cb_(0), del_obstacle_cb_(0), new_surface_cb_(0), mod_surface_cb_(0), del_surface_cb_(0) {}
 
   /**
    * Sets a function that will be called for every new obstacle.
@@ -70,30 +99,81 @@ public:
    */
   virtual void updateFrame(FrameDataPtr frameData);
 private:
+  /**
+   * The parameters of a primitive of an obstacle, as last reported.
+   * Spheres only use the first point.
+   */
+  struct PrimitiveState {
+    bool capsule;
+    double radius;
+    Coordinate first;
+    Coordinate second;
+  };
+  /**
+   * An obstacle that the `DiffAggregator` currently knows about, along with
+   * its state when it was last reported to the callbacks.
+   */
+  struct KnownObstacle {
+    ObjectModelPtr model;
+    std::vector<PrimitiveState> primitives;
+    long frame_num;
+  };
+  /**
+   * Collects the `PrimitiveState`s of the primitives of a model.
+   */
+  class StateVisitor : public ModelVisitor {
+  public:
+    StateVisitor(std::vector<PrimitiveState>& primitives) : primitives_(primitives) {}
+    void visitSphere(SphereModel& sphere) {
+      primitives_.push_back({false, sphere.radius(), sphere.center(), sphere.center()});
+    }
+    void visitCapsule(CapsuleModel& capsule) {
+      primitives_.push_back({true, capsule.radius(), capsule.first(), capsule.second()});
+    }
+  private:
+    std::vector<PrimitiveState>& primitives_;
+  };
+
+  /**
+   * Remembers the current state of the obstacle as the reported one.
+   */
+  void rememberState(KnownObstacle& known, long frame_num);
+  /**
+   * Checks whether the obstacle should be reported as modified, i.e. whether
+   * it changed beyond the tolerance since it was last reported and is not
+   * rate limited.
+   */
+  bool shouldReportModified(KnownObstacle& known, long frame_num);
+
   /**
    * The number of frames after which the difference to the previous snapshot
    * should be found.
    */
   int freq_;
+  /**
+   * The changes that obstacles need to exceed to be reported as modified.
+   */
+  ObstacleChangeTolerance tolerance_;
   /**
    * The current frame number.
    */
   int curr_;
   /**
-   * A set of model IDs found in the previous snapshot.
+   * The number of the current snapshot. Known models that were not seen in
+   * the current snapshot are deleted.
    */
-  std::set<int> previous_ids_;
-  std::set<int> previous_surface_ids_;
-
+  uint32_t snapshot_;
 
   /**
-   * Maps the ID of an obstacle to its ObjectModel smart pointer.
-   * Contains the obstacles that the `DiffAggregator` currently knows
-   * about.
+   * The obstacles and surfaces that the `DiffAggregator` currently knows
+   * about, by their ID.
    */
-  std::map<int, ObjectModelPtr> current_obstacles_;
-    std::map<int, SurfaceModelPtr> current_surfaces_;
-
+  util::FlatIdMap<KnownObstacle> obstacles_;
+  util::FlatIdMap<SurfaceModelPtr> surfaces_;
+  /**
+   * Scratch space for the current primitives of an obstacle.
+   */
+  std::vector<PrimitiveState> current_primitives_;
 
   // Callbacks that are invoked in the appropriate event.
   NewObstacleCallback new_obstacle_cb_;
@@ -106,92 +186,116 @@ private:
   DeletedSurfaceCallback del_surface_cb_;
 };
 
+inline void DiffAggregator::rememberState(KnownObstacle& known, long frame_num) {
+  known.primitives.clear();
+  StateVisitor visitor(known.primitives);
+  known.model->accept(visitor);
+  known.frame_num = frame_num;
+}
+
+inline bool DiffAggregator::shouldReportModified(KnownObstacle& known, long frame_num) {
+  if (frame_num - known.frame_num < tolerance_.min_interval) {
+    return false;
+  }
+
+  current_primitives_.clear();
+  StateVisitor visitor(current_primitives_);
+  known.model->accept(visitor);
+  if (current_primitives_.size() != known.primitives.size()) {
+    return true;
+  }
+
+  auto distance = [](Coordinate const& a, Coordinate const& b) {
+    Coordinate const d = a - b;
+    return std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+  };
+  for (size_t i = 0; i < current_primitives_.size(); ++i) {
+    PrimitiveState const& now = current_primitives_[i];
+    PrimitiveState const& then = known.primitives[i];
+    if (now.capsule != then.capsule || std::abs(now.radius - then.radius) > tolerance_.radius) {
+      return true;
+    }
+    if (!now.capsule) {
+      if (distance(now.first, then.first) > tolerance_.center) return true;
+      continue;
+    }
+    // The capsule is the same if its endpoints merely switched places.
+    bool const moved = distance(now.first, then.first) > tolerance_.endpoint
+                    || distance(now.second, then.second) > tolerance_.endpoint;
+    bool const moved_swapped = distance(now.first, then.second) > tolerance_.endpoint
+                            || distance(now.second, then.first) > tolerance_.endpoint;
+    if (moved && moved_swapped) return true;
+  }
+  return false;
+}
+
 // TODO This is made inline to facilitate keeping lepp3 header-only for now.
 inline void DiffAggregator::updateFrame(FrameDataPtr frameData) {
   const std::vector<ObjectModelPtr> &obstacles = frameData->obstacles;
   const std::vector<SurfaceModelPtr> &surfaces = frameData->surfaces;
+  long const frame_num = frameData->frameNum;
 
   ++curr_;
   if (curr_ % freq_ != 0) return;
+  ++snapshot_;
 
   // All IDs in the given list are either new or a modified representation of an
   // obstacle found in the previous snapshot.
-  std::set<int> current_ids;
-  size_t const sz = obstacles.size();
-  for (size_t i = 0; i < sz; ++i) {
-    int const id = obstacles[i]->id();
-    current_ids.insert(id);
+  for (size_t i = 0; i < obstacles.size(); ++i) {
+    bool inserted;
+    size_t const idx = obstacles_.insert(obstacles[i]->id(), inserted);
     // Start tracking (or update) the obstacle model.
-    current_obstacles_[id] = obstacles[i];
-    // Check if the obstacle was found in the previous snapshot...
-    if (previous_ids_.find(id) == previous_ids_.end()) {
+    KnownObstacle& known = obstacles_.value(idx);
+    known.model = obstacles[i];
+    obstacles_.lastSeen(idx) = snapshot_;
+    if (inserted) {
       // This is a new obstacle.
-      if (new_obstacle_cb_) new_obstacle_cb_(*obstacles[i], frameData->frameNum);
-    } else {
+      if (new_obstacle_cb_) new_obstacle_cb_(*known.model, frame_num);
+      rememberState(known, frame_num);
+    } else if (shouldReportModified(known, frame_num)) {
       // This is a modified obstacle.
-      if (mod_obstacle_cb_) mod_obstacle_cb_(*obstacles[i], frameData->frameNum);
+      if (mod_obstacle_cb_) mod_obstacle_cb_(*known.model, frame_num);
+      rememberState(known, frame_num);
     }
-    // ..and now remember it for the future.
-    previous_ids_.insert(id);
   }
 
-  std::set<int> current_surface_ids;
-  size_t const sz_ = surfaces.size();
-  std::cout << "DiffAggregator::updateFrame> Surfaces: " << sz_ << std::endl;
-  for (size_t i = 0; i < sz_; ++i) {
-    int const id = surfaces[i]->id();
-    current_surface_ids.insert(id);
-    // Start tracking (or update) the obstacle model.
-    current_surfaces_[id] = surfaces[i];
-    // Check if the obstacle was found in the previous snapshot...
-    if (previous_surface_ids_.find(id) == previous_surface_ids_.end()) {
-      // This is a new obstacle.
-      if (new_surface_cb_) new_surface_cb_(*surfaces[i], frameData->frameNum);
+  for (size_t i = 0; i < surfaces.size(); ++i) {
+    bool inserted;
+    size_t const idx = surfaces_.insert(surfaces[i]->id(), inserted);
+    surfaces_.value(idx) = surfaces[i];
+    surfaces_.lastSeen(idx) = snapshot_;
+    if (inserted) {
+      if (new_surface_cb_) new_surface_cb_(*surfaces[i], frame_num);
     } else {
-      // This is a modified obstacle.
-      if (mod_surface_cb_) mod_surface_cb_(*surfaces[i], frameData->frameNum);
+      if (mod_surface_cb_) mod_surface_cb_(*surfaces[i], frame_num);
     }
-    // ..and now remember it for the future.
-    previous_surface_ids_.insert(id);
   }
 
-  // The ids that are in the previous set, but not the current ones are deleted
-  // obstacles
-  std::vector<int> deleted;
-  std::set_difference(previous_ids_.begin(), previous_ids_.end(),
-                      current_ids.begin(), current_ids.end(),
-                      std::back_inserter(deleted));
-  for (size_t i = 0; i < deleted.size(); ++i) {
+  // The known obstacles that were not seen in this snapshot are deleted.
+  // Iterating backwards, the entry that takes the place of a removed one has
+  // already been visited.
+  for (size_t idx = obstacles_.size(); idx-- > 0;) {
+    if (obstacles_.lastSeen(idx) == snapshot_) continue;
     bool drop = true;
-    int const del_id = deleted[i];
     if (del_obstacle_cb_) {
       // Notify the callback that the object should be deleted
-      drop = del_obstacle_cb_(*current_obstacles_[del_id], frameData->frameNum);
+      drop = del_obstacle_cb_(*obstacles_.value(idx).model, frame_num);
     }
     if (drop) {
       // If the callback says that the object should be deleted (or there
       // was no callback set) then really finally drop it.
-      current_obstacles_.erase(del_id);
-      previous_ids_.erase(del_id);
+      obstacles_.remove(idx);
     }
   }
 
-  std::vector<int> deleted_surfaces;
-  std::set_difference(previous_surface_ids_.begin(), previous_surface_ids_.end(),
-                      current_surface_ids.begin(), current_surface_ids.end(),
-                      std::back_inserter(deleted_surfaces));
-  for (size_t i = 0; i < deleted_surfaces.size(); ++i) {
+  for (size_t idx = surfaces_.size(); idx-- > 0;) {
+    if (surfaces_.lastSeen(idx) == snapshot_) continue;
     bool drop = true;
-    int const del_id = deleted_surfaces[i];
     if (del_surface_cb_) {
-      // Notify the callback that the object should be deleted
-      drop = del_surface_cb_(*current_surfaces_[del_id], frameData->frameNum);
+      drop = del_surface_cb_(*surfaces_.value(idx), frame_num);
     }
     if (drop) {
-      // If the callback says that the object should be deleted (or there
-      // was no callback set) then really finally drop it.
-      current_surfaces_.erase(del_id);
-      previous_surface_ids_.erase(del_id);
+      surfaces_.remove(idx);
     }
   }
 }
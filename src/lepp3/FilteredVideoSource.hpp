@@ -184,6 +184,9 @@ void FilteredVideoSource<PointT>::updateFrame(
   PointCloudT& filtered = *cloud_filtered;
   cloud_filtered->is_dense = true;
   cloud_filtered->sensor_origin_ = source_cloud->sensor_origin_;
+  for (size_t i = 0; i < point_filters_.size(); ++i) {
+    point_filters_[i]->transformOrigin(cloud_filtered->sensor_origin_);
+  }
 
   // Apply point-wise filters to each received point and then pass it to the
   // concrete implementation to figure out how to filter the entire cloud.
@@ -10,12 +10,14 @@
 namespace lepp {
 
 struct FrameData {
-  FrameData(long num) : frameNum(num),
+  FrameData(long num) : frameNum(num), timestamp(0),
                         cloudMinusSurfaces(new PointCloudT()),
                         surfaceDetectionIteration(-1), surfaceReferenceFrameNum(-1),
                         planeCoeffsIteration(-1), planeCoeffsReferenceFrameNum(-1) {}
 
   long frameNum;
+  // capture time of the cloud in seconds, 0 if the source does not provide one
+  double timestamp;
   long surfaceDetectionIteration;
   long surfaceReferenceFrameNum;
   long planeCoeffsIteration;
@@ -97,6 +97,8 @@ void GeneralGrabberVideoSource<PointT>::cloud_cb_(
 
   FrameDataPtr frameData(new FrameData(++frameCount));
   frameData->cloud = cloud;
+  // PCL stamps are in microseconds
+  frameData->timestamp = cloud->header.stamp * 1e-6;
   this->setNextFrame(frameData);
 }
 
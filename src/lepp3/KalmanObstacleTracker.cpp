@@ -2,56 +2,141 @@
 
 namespace lepp {
 
-void KalmanObstacleTracker::update(std::vector<lepp::ObjectModelParams>& obstacles)
+void KalmanObstacleTracker::update(std::vector<lepp::ObjectModelParams>& obstacles, double timestamp)
 {
-  static double dt = 1.0/30.0; // time since previous update. Assume 30Hz on first call.
-             /// NOTE: Accuracy may depend on what's going on further up the pipeline.
-             ///       It may be worth looking into adding this to FrameData so we can
-             ///       keep it in sync with the sensor updates.
-  if (frameTimer_.running())
+  float const dt = timeStep(timestamp);
+
+  measured_.assign(ids_.size(), 0);
+  for (auto const& obstacle : obstacles)
   {
-    frameTimer_.stop();
-    dt = frameTimer_.duration() / 1000.0;
+    auto state = index_.find(obstacle.id);
+    if (state != index_.end())
+      measured_[state->second] = 1;
   }
-  frameTimer_.start();
+  predict(dt);
 
   for (auto& obstacle : obstacles)
   {
-    auto state = states_.find(obstacle.id);
-    if (state == states_.end()) // new obstacle
+    Eigen::Vector3f const pos = Eigen::Vector3f(obstacle.center.x,
+                                                obstacle.center.y,
+                                                obstacle.center.z);
+    auto state = index_.find(obstacle.id);
+    if (state == index_.end()) // new obstacle
     {
-      Eigen::Vector3f pos = Eigen::Vector3f(obstacle.center.x,
-                                            obstacle.center.y,
-                                            obstacle.center.z);
-      ObstacleFilter::State initialState(pos, Eigen::Vector3f::Zero()); // init w/ current position & zero velocity
-      ObstacleKalmanFilter kf;
-      kf.init(initialState);
-      states_[obstacle.id] = kf;
+      addTrack(obstacle.id, pos);
+      continue;
     }
-    else // existing obstacle
+
+    // existing obstacle: correct the prediction with the measured position
+    size_t const t = state->second;
+    float const gain_position = var_position_[t] / (var_position_[t] + noise_measurement);
+    float const gain_velocity = cov_position_velocity_[t] / (var_position_[t] + noise_measurement);
+    for (int axis = 0; axis < 3; ++axis)
     {
-      // get obstacle's current position
-      Eigen::Vector3f pos = Eigen::Vector3f(obstacle.center.x,
-                                            obstacle.center.y,
-                                            obstacle.center.z);
-      ObstacleFilter::SystemModel sys(noise_position, noise_velocity, dt);
-      ObstacleFilter::MeasurementModel mm(noise_measurement);
-      state->second.predict(sys);
-      auto newState = state->second.update(mm, ObstacleFilter::Measurement(pos));
-
-      obstacle.velocity = newState.velocity();
-      obstacle.center = newState.position();
+      float const innovation = pos[axis] - position_[axis][t];
+      position_[axis][t] += gain_position * innovation;
+      velocity_[axis][t] += gain_velocity * innovation;
     }
+    var_velocity_[t] -= gain_velocity * cov_position_velocity_[t];
+    cov_position_velocity_[t] -= gain_position * cov_position_velocity_[t];
+    var_position_[t] -= gain_position * var_position_[t];
+
+    obstacle.velocity = Coordinate(velocity_[0][t], velocity_[1][t], velocity_[2][t]);
+    obstacle.center = Coordinate(position_[0][t], position_[1][t], position_[2][t]);
   }
 }
 
 void KalmanObstacleTracker::reset(int id)
 {
-  auto state = states_.find(id);
-  if (state != states_.end())
+  auto state = index_.find(id);
+  if (state == index_.end())
+    return;
+
+  // move the last track into the place of the removed one
+  size_t const t = state->second;
+  size_t const last = ids_.size() - 1;
+  index_.erase(state);
+  if (t != last)
+  {
+    ids_[t] = ids_[last];
+    index_[ids_[t]] = t;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      position_[axis][t] = position_[axis][last];
+      velocity_[axis][t] = velocity_[axis][last];
+    }
+    var_position_[t] = var_position_[last];
+    cov_position_velocity_[t] = cov_position_velocity_[last];
+    var_velocity_[t] = var_velocity_[last];
+  }
+
+  ids_.pop_back();
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    position_[axis].pop_back();
+    velocity_[axis].pop_back();
+  }
+  var_position_.pop_back();
+  cov_position_velocity_.pop_back();
+  var_velocity_.pop_back();
+}
+
+double KalmanObstacleTracker::timeStep(double timestamp)
+{
+  if (timestamp > 0 && last_timestamp_ > 0 && timestamp > last_timestamp_)
+  {
+    // sensor time, so that dropped frames are accounted for
+    dt_ = timestamp - last_timestamp_;
+  }
+  else if (frameTimer_.running())
+  {
+    frameTimer_.stop();
+    dt_ = frameTimer_.duration() / 1000.0;
+  }
+  frameTimer_.start();
+  last_timestamp_ = timestamp;
+  return dt_;
+}
+
+void KalmanObstacleTracker::predict(float dt)
+{
+  size_t const N = ids_.size();
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    float* const position = position_[axis].data();
+    float const* const velocity = velocity_[axis].data();
+    float const* const measured = measured_.data();
+    for (size_t t = 0; t < N; ++t)
+      position[t] += measured[t] * dt * velocity[t];
+  }
+
+  // P = F * P * F^T + Q
+  float* const var_position = var_position_.data();
+  float* const cov_position_velocity = cov_position_velocity_.data();
+  float* const var_velocity = var_velocity_.data();
+  float const* const measured = measured_.data();
+  for (size_t t = 0; t < N; ++t)
+  {
+    float const step = measured[t] * dt;
+    var_position[t] += step * (2 * cov_position_velocity[t] + step * var_velocity[t]) + measured[t] * noise_position;
+    cov_position_velocity[t] += step * var_velocity[t];
+    var_velocity[t] += measured[t] * noise_velocity;
+  }
+}
+
+void KalmanObstacleTracker::addTrack(int id, Eigen::Vector3f const& position)
+{
+  index_[id] = ids_.size();
+  ids_.push_back(id);
+  for (int axis = 0; axis < 3; ++axis)
   {
-    states_.erase(state);
+    position_[axis].push_back(position[axis]);
+    velocity_[axis].push_back(0);
   }
+  // initial covariance is the identity
+  var_position_.push_back(1);
+  cov_position_velocity_.push_back(0);
+  var_velocity_.push_back(1);
 }
 
 }  // namespace lepp
@@ -1,12 +1,10 @@
 #ifndef LEPP3_KALMAN_OBSTACLE_TRACKER_H__
 #define LEPP3_KALMAN_OBSTACLE_TRACKER_H__
 
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
-#include <list>
-#include <map>
 
-#include "lepp3/ObstacleFilter.hpp"
 #include "lepp3/FrameData.hpp"
 
 #include "lepp3/util/Timer.hpp"
@@ -15,6 +13,18 @@
 
 namespace lepp {
 
+/**
+ * Constant-velocity Kalman filtering of the obstacle positions.
+ *
+ * The state of each track is its position and velocity, with the system and
+ * measurement noise given as variances (the same on each axis). Since the
+ * axes are independent and share all of the noise parameters, the 6x6
+ * covariance of a track is three identical 2x2 blocks, so only one
+ * position/velocity covariance is kept per track.
+ *
+ * The states of all tracks are kept in flat arrays (one per component) and
+ * predicted together, so the cost per obstacle is a handful of flops.
+ */
 class KalmanObstacleTracker
 {
 public:
@@ -33,8 +43,12 @@ public:
    * Runs an update pass on all obstacles in the given vector (or inits filters
    * for them if they're new) and updates their positions & velocities with
    * filtered values.
+   *
+   * The timestamp (in seconds) is the capture time of the frame the obstacles
+   * were detected in. If it is not available (not positive), the time between
+   * the calls is used instead.
    */
-  void update(std::vector<lepp::ObjectModelParams>& obstacles);
+  void update(std::vector<lepp::ObjectModelParams>& obstacles, double timestamp);
 
   /**
    * Discards any current tracking data for the given object
@@ -42,8 +56,36 @@ public:
   void reset(int id);
 
 private:
-  std::map<int, ObstacleKalmanFilter> states_; // map obstacle id to kalman state
-  HiResTimer frameTimer_; // used to track time between frames
+  /**
+   * Returns the time since the previous update, in seconds.
+   */
+  double timeStep(double timestamp);
+  /**
+   * Advances the tracks measured in the current frame by the given time step;
+   * the other tracks keep their state until they are measured again.
+   */
+  void predict(float dt);
+  /**
+   * Starts a new track at the given position, with zero velocity.
+   */
+  void addTrack(int id, Eigen::Vector3f const& position);
+
+  // maps obstacle id to the index of its track
+  std::unordered_map<int, size_t> index_;
+  // state of each track, one element per track
+  std::vector<int> ids_;
+  std::vector<float> position_[3];
+  std::vector<float> velocity_[3];
+  // covariance of each track (per axis)
+  std::vector<float> var_position_;
+  std::vector<float> cov_position_velocity_;
+  std::vector<float> var_velocity_;
+  // 1 for the tracks measured in the current frame, 0 for the others
+  std::vector<float> measured_;
+
+  HiResTimer frameTimer_; // used to track time between frames if there are no timestamps
+  double last_timestamp_ = 0;
+  double dt_ = 1.0 / 30.0; // time since previous update. Assume 30Hz on first call.
 
   // kalman filter parameters
   float noise_position    = 0.01f;
@@ -76,7 +118,7 @@ public:
         }
 
         // update kalman tracking for objects in current frame
-        tracker_.update(frameData->obstacleParams);
+        tracker_.update(frameData->obstacleParams, frameData->timestamp);
 
         // pass results on down the pipeline
         notifyObservers(frameData);
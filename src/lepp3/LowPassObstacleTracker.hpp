@@ -2,10 +2,14 @@
 #define LEPP3_LOW_PASS_OBSTACLE_TRACKER_H__
 
 #include <vector>
-#include <list>
 #include <map>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
 
 #include "lepp3/FrameData.hpp"
+#include "lepp3/util/Assignment.h"
+#include "lepp3/util/TrackStore.hpp"
 
 #include "deps/easylogging++.h"
 
@@ -49,6 +53,12 @@ private:
  * disappearance only if the obstacle has been gone in a sufficient number of
  * consecutive frames.
  *
+ * New obstacles are associated with the tracked ones by the distance of their
+ * center points. Candidate pairs within the gating distance are looked up in a
+ * uniform grid, and the pairs are then chosen globally (so that no two
+ * obstacles can claim the same track) by solving an assignment problem that
+ * matches as many obstacles as possible with the smallest total distance.
+ *
  * It emits the obstacles that it considers real in each frame to all
  * aggregators that are attached to it.
  *
@@ -60,10 +70,23 @@ private:
 class LowPassObstacleTracker : public FrameDataObserver, public FrameDataSubject
 {
 public:
+  struct Parameters {
+    // number of consecutive frames an obstacle has to be lost to be dropped
+    int LOST_LIMIT = 12;
+    // number of consecutive frames an obstacle has to be found to be materialized
+    int FOUND_LIMIT = 8;
+    // maximum squared distance of the center points of matching obstacles
+    double MAX_CENTER_DISTANCE = 0.05;
+  };
+
   /**
-   * Creates a new `LowPassObstacleTracker`.
+   * Creates a new `LowPassObstacleTracker` with the default parameters.
    */
   LowPassObstacleTracker();
+  /**
+   * Creates a new `LowPassObstacleTracker` with the given parameters.
+   */
+  LowPassObstacleTracker(Parameters const& params);
 
   /**
    * The member function that all concrete aggregators need to implement in
@@ -71,44 +94,37 @@ public:
    */
   virtual void updateFrame(FrameDataPtr frameData);
 private:
-  // Private types
-  /**
-   * The type that represents model IDs. For convenience it aliases an int.
-   */
-  typedef int model_id_t;
-
   /**
    * Computes the matching of the new obstacles to the obstacles that are being
    * tracked already.
    *
-   * If a new obstacle does not have a match in the ones being tracked, a new
-   * ID is assigned to it and it is added to the `tracked_models_`.
+   * Each tracked obstacle is matched to at most one new obstacle. If a new
+   * obstacle does not have a match in the ones being tracked, a new track (and
+   * ID) is created for it.
    *
-   * The returned map represents a mapping of model IDs (found in the
-   * `tracked_models_`) to the index of this obstacle in the `new_obstacles`
-   * list.
+   * The returned vector holds, for each track in `tracks_`, the index of its
+   * obstacle in the `new_obstacles` list, or -1 if it was not found.
    */
-  std::map<model_id_t, size_t> matchToPrevious(
+  std::vector<int> matchToPrevious(
       std::vector<ObjectModelPtr> const& new_obstacles);
   /**
    * Adapts the currently tracked objects by taking into account their new
    * representations.
    */
   void adaptTracked(
-      std::map<model_id_t, size_t> const& correspondence,
+      std::vector<int> const& correspondence,
       std::vector<ObjectModelPtr> const& new_obstacles,
       long frameNum);
   /**
-   * Updates the internal `frames_found_` and `frames_lost_` counters for each
-   * mode, based on the given new matches description, i.e. increments the
-   * seen counter for all models that were already tracked and found in the new
-   * frame (i.e. included in the `new_matches`); increments the lost counter for
-   * all models that were tracked, but not found in the new frame.
+   * Updates the found and lost counters of each track, based on the given
+   * new matches description, i.e. increments the seen counter for all models
+   * that were already tracked and found in the new frame; increments the lost
+   * counter for all models that were tracked, but not found in the new frame.
    *
    * The format of the given parameter is the one returned by the
    * `matchToPrevious` member function.
    */
-  void updateLostAndFound(std::map<model_id_t, size_t> const& new_matches);
+  void updateLostAndFound(std::vector<int> const& new_matches);
   /**
    * Drops any object that has been lost too many frames in a row.
    * This means that the object is removed from tracked objects, as well as no
@@ -123,163 +139,197 @@ private:
    */
   void materializeFoundObjects();
   /**
-   * Convenience function that copies the list of materialized objects to a list
-   * that can then be given to the underlying aggregator.
+   * Returns the index of the new obstacle matched to each of the tracked
+   * models with the given center points, or -1 for the unmatched ones.
    */
-   std::vector<ObjectModelPtr> copyMaterialized();
+  std::vector<int> assignTracks(
+      std::vector<ObjectModelPtr> const& new_obstacles,
+      std::vector<Coordinate> const& track_centers) const;
   /**
-   * The function returns the next available model ID. It makes sure that no
-   * models are ever assigned the same ID.
+   * Returns the key of the grid cell with the given coordinates.
    */
-  model_id_t nextModelId();
-  /**
-   * Returns the ID of a model tracked that matches the given model.
-   *
-   * The matching is done in such a way to return the model that whose
-   * characteristic point has the smallest distance from the point of the given
-   * mode, but given that the distance is below a certain threshold.
-   *
-   * Objects for which no such match can be found are given a new ID and this ID
-   * is returned.
-   */
-  model_id_t getMatchByDistance(ObjectModelPtr model);
+  static int64_t cellKey(int64_t x, int64_t y, int64_t z);
 
   // Private members
   /**
-   * Keeps track of which model ID is the next one that can be assigned.
-   */
-  model_id_t next_model_id_;
-  /**
-   * A mapping of model IDs to their `ObjectModel` representation.
-   */
-  std::map<model_id_t, boost::shared_ptr<ObjectModel> > tracked_models_;
-  /**
-   * A mapping of the model ID to the number of subsequent frames that the model
-   * was found in.
-   */
-  std::map<model_id_t, int> frames_found_;
-  /**
-   * A mapping of the model ID to the number of subsequent frames that the model
-   * was no longer found in.
-   */
-  std::map<model_id_t, int> frames_lost_;
-  /**
-   * Contains those models that are currently considered "real", i.e. not simply
+   * The tracked models, along with their found and lost counters. Those that
+   * are materialized are currently considered "real", i.e. not simply
    * perceived in one frame, but with sufficient certainty in many frames that
-   * we can claim it's a real object (therefore, it got "materialized").
-   * We use a linked-list for this purpose since we need efficient removals
-   * without copying elements or (importantly) invalidating iterators.
+   * we can claim it's a real object.
    */
-  std::list<ObjectModelPtr> materialized_models_;
-  /**
-   * Maps the model to their position in the linked list so as to allow removing
-   * objects efficiently.
-   * Theoretically, the removal would asymptotically be dominated by the map
-   * lookup (since it's a red-black tree, not a hash table). In practice, since
-   * the number of objects will always be extremely small, it may as well be
-   * O(1).
-   */
-  std::map<model_id_t, std::list<ObjectModelPtr>::iterator> model_idx_in_list_;
+  util::TrackStore<ObjectModelPtr> tracks_;
+
+  int const LOST_LIMIT;
+  int const FOUND_LIMIT;
+  double const MAX_CENTER_DISTANCE;
 };
 
 LowPassObstacleTracker::LowPassObstacleTracker()
-    : next_model_id_(0) {}
+    : LowPassObstacleTracker(Parameters()) {}
+
+LowPassObstacleTracker::LowPassObstacleTracker(Parameters const& params)
+    : LOST_LIMIT(params.LOST_LIMIT),
+      FOUND_LIMIT(params.FOUND_LIMIT),
+      MAX_CENTER_DISTANCE(params.MAX_CENTER_DISTANCE) {}
 
-LowPassObstacleTracker::model_id_t LowPassObstacleTracker::nextModelId() {
-  return next_model_id_++;
+int64_t LowPassObstacleTracker::cellKey(int64_t x, int64_t y, int64_t z) {
+  int64_t const mask = (int64_t(1) << 21) - 1;
+  return ((x & mask) << 42) | ((y & mask) << 21) | (z & mask);
 }
 
-LowPassObstacleTracker::model_id_t
-LowPassObstacleTracker::getMatchByDistance(ObjectModelPtr model) {
-  Coordinate const query_point = model->center_point();
-  bool found = false;
-  double min_dist = 1e10;
-  model_id_t match = 0;
-  for (std::map<model_id_t, ObjectModelPtr>::const_iterator it = tracked_models_.begin();
-        it != tracked_models_.end();
-        ++it) {
-    Coordinate const p(it->second->center_point());
-    double const dist =
-        (p.x - query_point.x) * (p.x - query_point.x) +
-        (p.y - query_point.y) * (p.y - query_point.y) +
-        (p.z - query_point.z) * (p.z - query_point.z);
-    if (dist <= 0.05) {
-      if (!found) min_dist = dist;
-      found = true;
-      if (dist <= min_dist) {
-        min_dist = dist;
-        match = it->first;
+std::vector<int> LowPassObstacleTracker::assignTracks(
+    std::vector<ObjectModelPtr> const& new_obstacles,
+    std::vector<Coordinate> const& track_centers) const {
+  size_t const num_obstacles = new_obstacles.size();
+  size_t const num_tracks = track_centers.size();
+  std::vector<int> track_obstacle(num_tracks, -1);
+  if (MAX_CENTER_DISTANCE <= 0 || num_obstacles == 0 || num_tracks == 0) {
+    return track_obstacle;
+  }
+
+  // Hash the tracked centers into a grid with cells as wide as the gate, so
+  // that all candidates of an obstacle are in the cells around its own.
+  double const cell_size = std::sqrt(MAX_CENTER_DISTANCE);
+  std::unordered_map<int64_t, std::vector<size_t> > grid;
+  for (size_t t = 0; t < num_tracks; ++t) {
+    Coordinate const& c = track_centers[t];
+    grid[cellKey(std::floor(c.x / cell_size), std::floor(c.y / cell_size), std::floor(c.z / cell_size))]
+        .push_back(t);
+  }
+
+  // Collect the candidate pairs within the gate. The obstacles and tracks form
+  // the nodes of a bipartite graph (obstacles first), which falls apart into
+  // small independent groups that are assigned separately.
+  struct Candidate {
+    size_t obstacle;
+    size_t track;
+    double dist;
+  };
+  std::vector<Candidate> candidates;
+  std::vector<size_t> parent(num_obstacles + num_tracks);
+  for (size_t i = 0; i < parent.size(); ++i) {
+    parent[i] = i;
+  }
+  auto find = [&parent](size_t node) {
+    while (parent[node] != node) {
+      node = parent[node] = parent[parent[node]];
+    }
+    return node;
+  };
+
+  for (size_t i = 0; i < num_obstacles; ++i) {
+    Coordinate const query_point = new_obstacles[i]->center_point();
+    int64_t const cx = std::floor(query_point.x / cell_size);
+    int64_t const cy = std::floor(query_point.y / cell_size);
+    int64_t const cz = std::floor(query_point.z / cell_size);
+    for (int64_t dx = -1; dx <= 1; ++dx) {
+      for (int64_t dy = -1; dy <= 1; ++dy) {
+        for (int64_t dz = -1; dz <= 1; ++dz) {
+          auto const cell = grid.find(cellKey(cx + dx, cy + dy, cz + dz));
+          if (cell == grid.end()) {
+            continue;
+          }
+          for (size_t t : cell->second) {
+            double const dist = (track_centers[t] - query_point).square_norm();
+            if (dist <= MAX_CENTER_DISTANCE) {
+              candidates.push_back({i, t, dist});
+              parent[find(i)] = find(num_obstacles + t);
+            }
+          }
+        }
       }
     }
   }
 
-  if (found) {
-    return match;
-  } else {
-    return nextModelId();
+  std::map<size_t, std::vector<Candidate> > groups;
+  for (Candidate const& candidate : candidates) {
+    groups[find(candidate.obstacle)].push_back(candidate);
+  }
+
+  // Within each group, pairs outside of the gate get a cost larger than any
+  // sum of gated distances, so that the assignment matches as many obstacles
+  // as possible first and only then minimizes the distances.
+  for (auto const& group : groups) {
+    // local row (obstacle) and column (track) indices of the group
+    std::map<size_t, int> rows;
+    std::map<size_t, int> cols;
+    std::vector<size_t> row_obstacle;
+    std::vector<size_t> col_track;
+    for (Candidate const& candidate : group.second) {
+      if (rows.insert(std::make_pair(candidate.obstacle, row_obstacle.size())).second) {
+        row_obstacle.push_back(candidate.obstacle);
+      }
+      if (cols.insert(std::make_pair(candidate.track, col_track.size())).second) {
+        col_track.push_back(candidate.track);
+      }
+    }
+
+    double const forbidden = MAX_CENTER_DISTANCE * (rows.size() + cols.size() + 1);
+    Eigen::MatrixXd cost = Eigen::MatrixXd::Constant(rows.size(), cols.size(), forbidden);
+    for (Candidate const& candidate : group.second) {
+      cost(rows[candidate.obstacle], cols[candidate.track]) = candidate.dist;
+    }
+
+    std::vector<int> const row_col = util::solveAssignment(cost);
+    for (size_t r = 0; r < row_col.size(); ++r) {
+      if (row_col[r] >= 0 && cost(r, row_col[r]) < forbidden) {
+        track_obstacle[col_track[row_col[r]]] = row_obstacle[r];
+      }
+    }
   }
+
+  return track_obstacle;
 }
 
-std::map<LowPassObstacleTracker::model_id_t, size_t>
-LowPassObstacleTracker::matchToPrevious(
+std::vector<int> LowPassObstacleTracker::matchToPrevious(
     std::vector<ObjectModelPtr> const& new_obstacles) {
-  // Maps the ID of the model to its index in the new list of obstacles.
-  // This lets us know the new approximation of each currently tracked object.
-  // If the model ID is not in the `tracked_models_`, it means we've got a new
-  // object in the stream.
-  std::map<model_id_t, size_t> correspondence;
-  // Keeps a list of objects that were new in the frame (the ID and its index
-  // in the `new_obstacles`). This is done in order to insert the new objects
-  // after the matching step, since we don't want some of the new objects to
-  // accidentaly get matched to one of the other new ones. Therefore, we defer
-  // the update of the tracked objects 'till after the matching step.
-  std::vector<std::pair<model_id_t, size_t> > new_in_frame;
-
-  // First we match each new obstacle to one of the models that is currently
-  // being tracked or give it a brand new model ID, if we are unable to find a
-  // match.
-  for (size_t i = 0; i < new_obstacles.size(); ++i) {
-    model_id_t model_id = new_obstacles[i]->id();
-    model_id = getMatchByDistance(new_obstacles[i]);
+  std::vector<Coordinate> track_centers(tracks_.size());
+  for (size_t t = 0; t < tracks_.size(); ++t) {
+    track_centers[t] = tracks_.model(t)->center_point();
+  }
 
-    correspondence[model_id] = i;
-    // If this one wasn't in the tracked models before, add it!
-    if (tracked_models_.find(model_id) == tracked_models_.end()) {
-      new_in_frame.push_back(std::make_pair(model_id, i));
+  // First we match the new obstacles to the models that are currently being
+  // tracked...
+  std::vector<int> correspondence = assignTracks(new_obstacles, track_centers);
+  std::vector<bool> matched(new_obstacles.size(), false);
+  for (size_t t = 0; t < correspondence.size(); ++t) {
+    if (correspondence[t] >= 0) {
+      matched[correspondence[t]] = true;
     }
   }
 
-  // We start tracking each obstacle for which we were unable to find a match
-  // in the currently tracked list of objects.
-  for (size_t i = 0; i < new_in_frame.size(); ++i) {
-    model_id_t const& model_id = new_in_frame[i].first;
-    size_t const corresp = new_in_frame[i].second;
-    tracked_models_[model_id] = new_obstacles[corresp];
-    frames_lost_[model_id] = 0;
-    frames_found_[model_id] = 0;
+  // ...and then start tracking each obstacle for which we were unable to find
+  // a match, giving it a brand new model ID.
+  for (size_t i = 0; i < new_obstacles.size(); ++i) {
+    if (matched[i]) {
+      continue;
+    }
+    model_id_t const model_id = tracks_.add(new_obstacles[i]);
+    correspondence.push_back(i);
     // We assign it the ID here too!
-    new_obstacles[corresp]->set_id(model_id);
+    new_obstacles[i]->set_id(model_id);
   }
 
   return correspondence;
 }
 
 void LowPassObstacleTracker::adaptTracked(
-    std::map<model_id_t, size_t> const& correspondence,
+    std::vector<int> const& correspondence,
     std::vector<ObjectModelPtr> const& new_obstacles,
     long frameNum) {
-  for (std::map<model_id_t, size_t>::const_iterator it = correspondence.begin();
-        it != correspondence.end();
-        ++it) {
-    model_id_t const& model_id = it->first;
-    int const& i = it->second;
+  for (size_t t = 0; t < correspondence.size(); ++t) {
+    int const i = correspondence[t];
+    if (i < 0) {
+      continue;
+    }
+    ObjectModelPtr const& tracked_model = tracks_.model(t);
     // Blend the new representation into the one we're tracking
     Coordinate const translation_vec =
-        (new_obstacles[i]->center_point() - tracked_models_[model_id]->center_point()) / 2;
+        (new_obstacles[i]->center_point() - tracked_model->center_point()) / 2;
     BlendVisitor blender(translation_vec);
-    tracked_models_[model_id]->accept(blender);
+    tracked_model->accept(blender);
     if (frameNum % 30 == 0) {
-      CompositeModel* tracked = dynamic_cast<CompositeModel*>(&*tracked_models_[model_id]);
+      CompositeModel* tracked = dynamic_cast<CompositeModel*>(&*tracked_model);
       CompositeModel* new_model = dynamic_cast<CompositeModel*>(&*new_obstacles[i]);
       if (tracked && new_model) {
         tracked->set_models(new_model->models());
@@ -289,75 +339,36 @@ void LowPassObstacleTracker::adaptTracked(
 }
 
 void LowPassObstacleTracker::updateLostAndFound(
-    std::map<model_id_t, size_t> const& new_matches) {
-  for (std::map<model_id_t, boost::shared_ptr<ObjectModel> >::const_iterator it = tracked_models_.begin();
-        it != tracked_models_.end();
-        ++it) {
-    model_id_t const& model_id = it->first;
-    if (new_matches.find(model_id) != new_matches.end()) {
+    std::vector<int> const& new_matches) {
+  for (size_t t = 0; t < tracks_.size(); ++t) {
+    if (new_matches[t] >= 0) {
       // Update the seen count only if the object isn't already materialized.
-      if (model_idx_in_list_.find(model_id) == model_idx_in_list_.end()) {
-        ++frames_found_[model_id];
+      if (!tracks_.materialized(t)) {
+        ++tracks_.framesFound(t);
       }
       // ...but always reset its lost counter, since we've now seen it.
-      frames_lost_[model_id] = 0;
+      tracks_.framesLost(t) = 0;
     } else {
-      ++frames_lost_[model_id];
-      frames_found_[model_id] = 0;
+      ++tracks_.framesLost(t);
+      tracks_.framesFound(t) = 0;
     }
   }
 }
 
 void LowPassObstacleTracker::dropLostObjects() {
-  // Drop obstacles that haven't been seen in a while
-  // !!!NOTE!!! Deleting while iterating is no longer the same in C++11!
-  std::map<model_id_t, int>::iterator it = frames_lost_.begin();
-  int const LOST_LIMIT = 12;
-  while (it != frames_lost_.end()) {
-    if (it->second >= LOST_LIMIT) {
-      //LTRACE << "Object " << it->first << " not found 5 times in a row: DROPPING";
-      // Stop tracking the model, since it's been gone for a while.
-      if (tracked_models_.find(it->first) != tracked_models_.end()) {
-        tracked_models_.erase(tracked_models_.find(it->first));
-      }
-      // If the model was also materialized, make sure we drop it from there too
-      if (model_idx_in_list_.find(it->first) != model_idx_in_list_.end()) {
-        materialized_models_.erase(model_idx_in_list_[it->first]);
-        model_idx_in_list_.erase(model_idx_in_list_.find(it->first));
-      }
-      // Remove the helper tracking data too.
-      if (frames_found_.find(it->first) != frames_found_.end()) {
-        frames_found_.erase(frames_found_.find(it->first));
-      }
-      frames_lost_.erase(it++);
-    } else {
-      ++it;
+  // Drop obstacles that haven't been seen in a while. Removing a track moves
+  // the last one into its place, so we go backwards.
+  for (size_t t = tracks_.size(); t-- > 0;) {
+    if (tracks_.framesLost(t) >= LOST_LIMIT) {
+      tracks_.remove(t);
     }
   }
 }
 
 void LowPassObstacleTracker::materializeFoundObjects() {
-  int const FOUND_LIMIT = 8;
-  std::map<model_id_t, int>::iterator it = frames_found_.begin();
-  while (it != frames_found_.end()) {
-    // Deconstruct the iterator pair for convenience
-    model_id_t const model_id = it->first;
-    int const seen_count = it->second;
-    if (seen_count >= FOUND_LIMIT) {
-      //LTRACE << "Object found " << model_id << " 5 times in a row: INCLUDING!";
-      // Get the corresponding model
-      ObjectModelPtr const& model = tracked_models_.find(model_id)->second;
-      // Materialize it...
-      materialized_models_.push_back(model);
-      // ...and make sure we know where in the list it got inserted.
-      std::list<ObjectModelPtr>::iterator pos = materialized_models_.end();
-      --pos;
-      model_idx_in_list_[model_id] = pos;
-      // Finally, make sure we remove it from the mapping so that we don't end
-      // up adding it more than once to the list of materialized objects.
-      frames_found_.erase(it++);
-    } else {
-      ++it;
+  for (size_t t = 0; t < tracks_.size(); ++t) {
+    if (!tracks_.materialized(t) && tracks_.framesFound(t) >= FOUND_LIMIT) {
+      tracks_.setMaterialized(t);
     }
   }
 }
@@ -366,14 +377,12 @@ void LowPassObstacleTracker::updateFrame(FrameDataPtr frameData)
 {
   if (frameData->cloudMinusSurfaces->size() != 0)
   {
-    std::map<model_id_t, size_t> correspondence = matchToPrevious(frameData->obstacles);
+    std::vector<int> const correspondence = matchToPrevious(frameData->obstacles);
     updateLostAndFound(correspondence);
     adaptTracked(correspondence, frameData->obstacles, frameData->frameNum);
     dropLostObjects();
     materializeFoundObjects();
-     // copy materialized models
-    std::vector<ObjectModelPtr> materializedModelsCopy(materialized_models_.begin(), materialized_models_.end());
-    frameData->obstacles = materializedModelsCopy;
+    frameData->obstacles = tracks_.materializedModels();
   }
   notifyObservers(frameData);
 }
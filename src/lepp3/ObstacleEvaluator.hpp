@@ -1,8 +1,12 @@
 #ifndef LEPP3_OBSTACLE_EVALUATOR_H_
 #define LEPP3_OBSTACLE_EVALUATOR_H_
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <sstream>
+#include <vector>
 #include "lepp3/FrameData.hpp"
 #include "lepp3/util/util.h"
 /**
@@ -13,6 +17,12 @@
  *
  * The volume computation is done by creating a 3D grid around the model and
  * estimating how many points on the grid are occupied.
+ *
+ * Rather than testing each grid point against each part, every vertical grid
+ * column is intersected analytically with the parts whose bounding boxes it
+ * passes through. Each such intersection is a single interval, since the parts
+ * are convex, so the occupied points of the column are counted from the union
+ * of the intervals. The columns are processed in parallel.
  */
 class VolumeEstimator : public ModelVisitor {
 public:
@@ -40,22 +50,36 @@ public:
   int estimateVolume();
 private:
   /**
-   * Checks if the current point on the 3D grid (a.k.a the bounding box around
-   * the model) is inside the model.
+   * A part of the model: all points closer than `radius` to the segment
+   * between `first` and `second`. Spheres have coinciding end points.
    */
-  bool isVoxelOccupied(double const& x, double const& y, double const& z);
+  struct Part {
+    Eigen::Vector3d first;
+    Eigen::Vector3d second;
+    double radius;
+    /**
+     * The bounding box of the part.
+     */
+    Eigen::Vector3d min;
+    Eigen::Vector3d max;
+  };
   /**
-   * Minimum/Maximum points of the bounding box surrounding the model.
+   * Adds a part to the model and extends the bounding box of the model.
    */
-  Coordinate min_p_, max_p_;
+  void addPart(Eigen::Vector3d const& first, Eigen::Vector3d const& second, double radius);
   /**
-   * Container to hold track of sphere models in a `CompositeModel`
+   * Finds the interval (lo, hi) of heights at which the vertical line through
+   * (x, y) lies inside the given part. Returns false if it misses the part.
    */
-  std::vector<SphereModel> spheres_;
+  static bool intersectColumn(Part const& part, double x, double y, double& lo, double& hi);
   /**
-   * Container to hold track of capsule models in a `CompositeModel`
+   * Minimum/Maximum points of the bounding box surrounding the model.
    */
-  std::vector<CapsuleModel> capsules_;
+  Coordinate min_p_, max_p_;
+  /**
+   * The spheres and capsules of a `CompositeModel`.
+   */
+  std::vector<Part> parts_;
   /**
    * Number of sub-models in this model. This determines how many split operations
    * have been executed
@@ -64,95 +88,103 @@ private:
 };
 void VolumeEstimator::visitSphere(lepp::SphereModel& sphere) {
   ++num_splits_;
-  // Store the current Sphere model.
-  spheres_.push_back(sphere);
   Coordinate const center = sphere.center_point();
-  double const max_x = center.x + sphere.radius();
-  double const max_y = center.y + sphere.radius();
-  double const max_z = center.z + sphere.radius();
-  double const min_x = center.x - sphere.radius();
-  double const min_y = center.y - sphere.radius();
-  double const min_z = center.z - sphere.radius();
-  max_p_.x = std::max(max_p_.x, max_x);
-  max_p_.y = std::max(max_p_.y, max_y);
-  max_p_.z = std::max(max_p_.z, max_z);
-  min_p_.x = std::min(min_p_.x, min_x);
-  min_p_.y = std::min(min_p_.y, min_y);
-  min_p_.z = std::min(min_p_.z, min_z);
-  double volume = 4/3*M_PI*sphere.radius()*sphere.radius()*sphere.radius();
-  //std::cout << volume << std::endl;
+  Eigen::Vector3d const c(center.x, center.y, center.z);
+  addPart(c, c, sphere.radius());
 }
 void VolumeEstimator::visitCapsule(lepp::CapsuleModel& capsule) {
   ++num_splits_;
-  // Store the current Capsule model.
-  capsules_.push_back(capsule);
-  Coordinate first = capsule.first();
-  Coordinate second = capsule.second();
-  double a = std::sqrt((first.x - second.x)*(first.x - second.x) + (first.y - second.y)*(first.y - second.y) + (first.z - second.z)*(first.z - second.z));
-  double volume = M_PI*capsule.radius()*capsule.radius()*(4/3*capsule.radius() + a);
-  //std::cout << volume << std::endl;
-  Coordinate min, max;
-  min.x = std::min(first.x, second.x);
-  min.y = std::min(first.y, second.y);
-  min.z = std::min(first.z, second.z);
-  max.x = std::max(first.x, second.x);
-  max.y = std::max(first.y, second.y);
-  max.z = std::max(first.z, second.z);
-  // Add the capsule radius to min/max
-  min.x -= capsule.radius();
-  min.y -= capsule.radius();
-  min.z -= capsule.radius();
-  max.x += capsule.radius();
-  max.y += capsule.radius();
-  max.z += capsule.radius();
+  Coordinate const first = capsule.first();
+  Coordinate const second = capsule.second();
+  addPart(Eigen::Vector3d(first.x, first.y, first.z),
+          Eigen::Vector3d(second.x, second.y, second.z),
+          capsule.radius());
+}
+void VolumeEstimator::addPart(
+    Eigen::Vector3d const& first, Eigen::Vector3d const& second, double radius) {
+  Part part;
+  part.first = first;
+  part.second = second;
+  part.radius = radius;
+  part.min = first.cwiseMin(second).array() - radius;
+  part.max = first.cwiseMax(second).array() + radius;
+  parts_.push_back(part);
   // Find the global min/max
-  min_p_.x = std::min(min_p_.x, min.x);
-  min_p_.y = std::min(min_p_.y, min.y);
-  min_p_.z = std::min(min_p_.z, min.z);
-  max_p_.x = std::max(max_p_.x, max.x);
-  max_p_.y = std::max(max_p_.y, max.y);
-  max_p_.z = std::max(max_p_.z, max.z);
+  min_p_.x = std::min(min_p_.x, part.min.x());
+  min_p_.y = std::min(min_p_.y, part.min.y());
+  min_p_.z = std::min(min_p_.z, part.min.z());
+  max_p_.x = std::max(max_p_.x, part.max.x());
+  max_p_.y = std::max(max_p_.y, part.max.y());
+  max_p_.z = std::max(max_p_.z, part.max.z());
 }
-bool VolumeEstimator::isVoxelOccupied(
-    double const& x, double const& y, double const& z) {
-  // Go through all spheres of the current model and check if the point is
-  // inside one of them.
-  {
-    size_t sz = spheres_.size();
-    for (size_t i=0; i<sz; ++i) {
-      double const r = spheres_[i].radius();
-      Coordinate const& center = spheres_[i].center_point();
-      double const distance =
-          (center.x - x) * (center.x - x) + (center.y - y) * (center.y - y) + (center.z - z) * (center.z - z);
-      if (distance <= r * r)
-        return true;
+bool VolumeEstimator::intersectColumn(
+    Part const& part, double x, double y, double& lo, double& hi) {
+  double const r2 = part.radius * part.radius;
+  double const inf = std::numeric_limits<double>::infinity();
+  lo = inf;
+  hi = -inf;
+  // The part is the union of the spheres around its end points and the
+  // cylinder between them. It is convex, so the column intersects it in the
+  // hull of the intervals in which it intersects those three.
+  for (Eigen::Vector3d const* end : { &part.first, &part.second }) {
+    double const dx = x - end->x();
+    double const dy = y - end->y();
+    double const h2 = r2 - dx * dx - dy * dy;
+    if (h2 > 0) {
+      double const h = std::sqrt(h2);
+      lo = std::min(lo, end->z() - h);
+      hi = std::max(hi, end->z() + h);
     }
   }
-  // Go through all capsules of the current model and check if the point is
-  // inside one of them.
-  {
-    size_t sz = capsules_.size();
-    for (size_t i=0; i<sz; ++i) {
-      double r = capsules_[i].radius();
-      /*
-       * Prepare the pcl::sqrPointToLineDistance input arguments.
-       */
-      // line_dir: line direction vector
-      Coordinate l = capsules_[i].second() - capsules_[i].first();
-      Eigen::Vector4f line_dir(l.x, l.y, l.z, 0.);
-      // line_pt: a point on the line
-      Eigen::Vector4f line_pt(
-          capsules_[i].second().x,
-          capsules_[i].second().y,
-          capsules_[i].second().z,
-          0.);
-      Eigen::Vector4f pt(x, y, z, 0);
-      double const distance = pcl::sqrPointToLineDistance(pt, line_pt, line_dir);
-      if (distance < r*r)
-        return true;
+
+  Eigen::Vector3d const axis = part.second - part.first;
+  double const length = axis.norm();
+  if (length > 0) {
+    // The column is p(z) = w0 + z * e_z relative to the first end point. Its
+    // squared distance to the axis is a quadratic in z, and its projection onto
+    // the axis is linear in z.
+    Eigen::Vector3d const u = axis / length;
+    Eigen::Vector3d const w0(x - part.first.x(), y - part.first.y(), -part.first.z());
+    double const s0 = w0.dot(u);
+    Eigen::Vector3d const p = w0 - s0 * u;
+    Eigen::Vector3d const q = Eigen::Vector3d::UnitZ() - u.z() * u;
+    double const pp = p.squaredNorm();
+    double const pq = p.dot(q);
+    double const qq = q.squaredNorm();
+
+    // within the radius of the axis
+    double cyl_lo = -inf;
+    double cyl_hi = inf;
+    bool hit = true;
+    if (qq < 1e-12) {
+      hit = pp < r2;
+    } else {
+      double const disc = pq * pq - qq * (pp - r2);
+      hit = disc > 0;
+      if (hit) {
+        double const root = std::sqrt(disc);
+        cyl_lo = (-pq - root) / qq;
+        cyl_hi = (-pq + root) / qq;
+      }
+    }
+    // between the end points
+    if (hit) {
+      if (std::abs(u.z()) < 1e-12) {
+        hit = s0 >= 0 && s0 <= length;
+      } else {
+        double const z0 = -s0 / u.z();
+        double const z1 = (length - s0) / u.z();
+        cyl_lo = std::max(cyl_lo, std::min(z0, z1));
+        cyl_hi = std::min(cyl_hi, std::max(z0, z1));
+      }
+    }
+    if (hit && cyl_lo < cyl_hi) {
+      lo = std::min(lo, cyl_lo);
+      hi = std::max(hi, cyl_hi);
     }
   }
-  return false;
+
+  return lo < hi;
 }
 int VolumeEstimator::estimateVolume() {
   // NOTE: All the values are in METERS
@@ -160,12 +192,45 @@ int VolumeEstimator::estimateVolume() {
   // models.
   // TODO: 3D grid creation should depend on the point cloud resolution
   double const step_size = 0.01;
+  if (parts_.empty()) {
+    return 0;
+  }
+  int const nx = static_cast<int>(std::ceil((max_p_.x - min_p_.x) / step_size));
+  int const ny = static_cast<int>(std::ceil((max_p_.y - min_p_.y) / step_size));
+  int const nz = static_cast<int>(std::ceil((max_p_.z - min_p_.z) / step_size));
+
   int volume = 0;
-  for (double x = min_p_.x; x < max_p_.x; x += step_size) {
-    for (double y = min_p_.y; y < max_p_.y; y += step_size) {
-      for (double z = min_p_.z; z < max_p_.z; z += step_size) {
-        if (isVoxelOccupied(x, y, z))
-          ++volume;
+#pragma omp parallel for schedule(dynamic) reduction(+:volume)
+  for (int i = 0; i < nx; ++i) {
+    double const x = min_p_.x + i * step_size;
+    // the grid points of a column covered by each part, as index ranges
+    std::vector<std::pair<int, int>> ranges;
+    for (int j = 0; j < ny; ++j) {
+      double const y = min_p_.y + j * step_size;
+      ranges.clear();
+      for (Part const& part : parts_) {
+        double lo, hi;
+        if (x < part.min.x() || x > part.max.x() || y < part.min.y() || y > part.max.y()
+            || !intersectColumn(part, x, y, lo, hi)) {
+          continue;
+        }
+        // the grid points strictly inside (lo, hi)
+        int const first = std::max(0, static_cast<int>(std::floor((lo - min_p_.z) / step_size)) + 1);
+        int const last = std::min(nz - 1, static_cast<int>(std::ceil((hi - min_p_.z) / step_size)) - 1);
+        if (first <= last) {
+          ranges.emplace_back(first, last);
+        }
+      }
+
+      // count the grid points of the union of the ranges
+      std::sort(ranges.begin(), ranges.end());
+      int covered_until = -1;
+      for (auto const& range : ranges) {
+        int const first = std::max(range.first, covered_until + 1);
+        if (range.second >= first) {
+          volume += range.second - first + 1;
+          covered_until = range.second;
+        }
       }
     }
   }
@@ -72,7 +72,7 @@ void VideoSource<PointT>::setNextFrame(FrameDataPtr frameData)
 {
   // fetch pose (if available)
   if (pose_service_) {
-    pose_service_->triggerNextFrame();
+    pose_service_->triggerNextFrame(frameData->timestamp);
     frameData->lolaKinematics = std::make_shared<lepp::LolaKinematicsParams>(pose_service_->getParams());
   }
   FrameDataSubject::notifyObservers(frameData);
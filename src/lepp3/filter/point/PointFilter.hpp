@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include <Eigen/Core>
+
 namespace lepp {
 
 template<class PointT>
@@ -12,6 +14,14 @@ public:
   virtual bool apply(PointT& pt) = 0;
   virtual void prepareNext() = 0;
 
+  /**
+   * @brief Moves the sensor origin of the cloud along with its points
+   *
+   * Filters that transform the coordinates of the points have to transform
+   * the origin the same way, so that the distances to the sensor are kept
+   */
+  virtual void transformOrigin(Eigen::Vector4f& origin) {}
+
   /**
    * @brief Defines an order value for a filter
    *
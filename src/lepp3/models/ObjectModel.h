@@ -12,6 +12,8 @@ namespace lepp {
 class ModelVisitor;
 class SphereModel;
 class CapsuleModel;
+struct GeometryDescriptor;
+struct PointRange;
 
 /**
  * The base class for all geometrical models that can be used to represent
@@ -65,6 +67,10 @@ struct ObjectModelParams {
   Coordinate velocity = Coordinate(std::nan(""), std::nan(""), std::nan(""));
   Eigen::Vector3f inertial_values;
   std::vector<Eigen::Vector3f> inertial_axes;
+  // the part of obstacleCloud that makes up the object, if not all of it
+  std::shared_ptr<PointRange const> points;
+  // the geometry of the object's points, if it has already been computed
+  std::shared_ptr<GeometryDescriptor const> geometry;
 
   ObjectModelParams() {}
   ObjectModelParams(PointCloudPtr p) : obstacleCloud(p) {}
@@ -0,0 +1,49 @@
+#include "GeometryDescriptor.hpp"
+
+#include <limits>
+
+lepp::GeometryDescriptor::GeometryDescriptor()
+    : size(0),
+      centroid(Eigen::Vector3f::Zero()),
+      covariance(Eigen::Matrix3f::Zero()),
+      eigenvalues(Eigen::Vector3f::Zero()),
+      eigenvectors(Eigen::Matrix3f::Identity()),
+      min(Eigen::Vector3f::Zero()),
+      max(Eigen::Vector3f::Zero()) {
+}
+
+lepp::GeometryDescriptor::GeometryDescriptor(PointRange const& points)
+    : GeometryDescriptor() {
+  size = points.size();
+  if (size == 0) {
+    return;
+  }
+
+  // Accumulate the moments relative to the first point in double precision,
+  // which keeps the covariance accurate for clouds far from the origin.
+  Eigen::Vector3f const origin = points[0].getVector3fMap();
+  Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+  Eigen::Matrix3d sum_squares = Eigen::Matrix3d::Zero();
+  min = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+  max = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+  for (size_t i = 0; i < size; ++i) {
+    Eigen::Vector3f const p = points[i].getVector3fMap();
+    min = min.cwiseMin(p);
+    max = max.cwiseMax(p);
+    Eigen::Vector3d const d = (p - origin).cast<double>();
+    sum += d;
+    sum_squares += d * d.transpose();
+  }
+
+  Eigen::Vector3d const mean = sum / static_cast<double>(size);
+  centroid = origin + mean.cast<float>();
+  covariance = (sum_squares / static_cast<double>(size) - mean * mean.transpose()).cast<float>();
+
+  // The solver sorts the eigenvalues in ascending order, so reverse them.
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+  for (int i = 0; i < 3; ++i) {
+    eigenvalues(i) = solver.eigenvalues()(2 - i);
+    eigenvectors.col(i) = solver.eigenvectors().col(2 - i);
+  }
+  eigenvectors.col(2) = eigenvectors.col(0).cross(eigenvectors.col(1));
+}
@@ -0,0 +1,52 @@
+#ifndef LEPP3_OBJECT_APPROXIMATOR_GEOMETRY_DESCRIPTOR_H__
+#define LEPP3_OBJECT_APPROXIMATOR_GEOMETRY_DESCRIPTOR_H__
+
+#include <Eigen/Dense>
+
+#include "lepp3/Typedefs.hpp"
+#include "PointRange.hpp"
+
+namespace lepp {
+
+/**
+ * The geometric properties of a point cloud that the split conditions, split
+ * strategies and approximators base their decisions on.
+ *
+ * All of them are computed in a single pass over the cloud, so that each part
+ * of a split tree only needs to be described once, regardless of how many
+ * components look at it.
+ */
+struct GeometryDescriptor {
+  GeometryDescriptor();
+  /**
+   * Describes the points of the given range.
+   */
+  explicit GeometryDescriptor(PointRange const& points);
+
+  /**
+   * The number of points in the cloud.
+   */
+  size_t size;
+  Eigen::Vector3f centroid;
+  /**
+   * The covariance matrix of the points.
+   */
+  Eigen::Matrix3f covariance;
+  /**
+   * The eigenvalues of the covariance matrix in descending order, with the
+   * corresponding eigenvectors (the principal axes) in the columns of
+   * `eigenvectors`. The axes form a right-handed coordinate system, the same
+   * as the one given by `pcl::PCA`.
+   */
+  Eigen::Vector3f eigenvalues;
+  Eigen::Matrix3f eigenvectors;
+  /**
+   * The bounds of the axis-aligned bounding box of the cloud.
+   */
+  Eigen::Vector3f min;
+  Eigen::Vector3f max;
+};
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "lepp3/Typedefs.hpp"
 #include "ObjectApproximator.hpp"
+#include "GeometryDescriptor.hpp"
 
 namespace lepp {
 
@@ -19,26 +20,41 @@ public:
 private:
   // Private helper member functions for fitting individual models.
   // Takes a pointer to a model and a descriptor and sets the parameters of the
-  // model so that it describes the point cloud with the given features in the
+  // model so that it describes the points with the given features in the
   // best way.
-  // The implementations of the functions are pretty much a copy-paste of the
-  // legacy code (ergo not very clean).
-  // TODO Clean up the implementations of the functions (e.g. lots of unused variables)
   // TODO Refactor them in terms of the `ModelVisitor` API (`FittingVisitor`).
   void performFitting(boost::shared_ptr<SphereModel> sphere,
-                      const PointCloudConstPtr& point_cloud,
+                      const PointRange& points,
                       Eigen::Vector3f mass_center,
                       std::vector <Eigen::Vector3f> const& axes);
   void performFitting(boost::shared_ptr<CapsuleModel> capsule,
-                      const PointCloudConstPtr& point_cloud,
+                      const PointRange& points,
                       Eigen::Vector3f mass_center,
                       std::vector <Eigen::Vector3f> const& axes);
+  /**
+   * The extents of a point cloud relative to a center point: the range of the
+   * point projections onto each of the inertial axes (the bounds are never on
+   * the wrong side of the center) and the largest squared distance of a point
+   * from the center.
+   */
+  struct AxisExtents {
+    Eigen::Vector3f min;
+    Eigen::Vector3f max;
+    float max_squared_distance;
+  };
+  /**
+   * Computes the `AxisExtents` of the given points in a single pass.
+   */
+  static AxisExtents computeAxisExtents(
+      const PointRange& points,
+      Eigen::Vector3f const& center,
+      std::vector<Eigen::Vector3f> const& axes);
   /**
    * Returns a point representing an estimation of the position of the center
-   * of mass for the given point cloud.
+   * of mass for the point cloud with the given geometry.
    */
   Eigen::Vector3f estimateMassCenter(
-      const PointCloudConstPtr& point_cloud);
+      const GeometryDescriptor& geometry);
 };
 
 } // namespace lepp
@@ -11,35 +11,48 @@ lepp::ObjectApproximator::ObjectApproximator(double max_squared_distance)
 }
 
 void lepp::ObjectApproximator::updateFrame(FrameDataPtr frameData) {
-  frameData->obstacles.clear();
+  std::vector<ObjectModelParams>& params = frameData->obstacleParams;
+  const int numObstacles = static_cast<int>(params.size());
 
-  // iterate in reverse, we need to remove clouds for invalid obstacles
-  for (size_t i = frameData->obstacleParams.size() - 1; i < frameData->obstacleParams.size(); --i) {
+  // the obstacles are independent, so approximate them in parallel
+  std::vector<ObjectModelPtr> obstacles(numObstacles);
+  std::vector<char> valid(numObstacles);
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int i = 0; i < numObstacles; ++i) {
 #ifdef LEPP3_ENABLE_TRACING
     tracepoint(lepp3_trace_provider, ssv_approx_start);
 #endif
 
-    ObjectModelPtr obstacle = approximate(frameData->obstacleParams[i]);
+    ObjectModelPtr obstacle = approximate(params[i]);
 
 #ifdef LEPP3_ENABLE_TRACING
     tracepoint(lepp3_trace_provider, ssv_approx_end);
 #endif
 
     // if the obstacle params contained a valid id, pass it on to this obstacle
-    if (frameData->obstacleParams[i].id >= 0)
+    if (params[i].id >= 0)
     {
-      obstacle->set_id(frameData->obstacleParams[i].id);
+      obstacle->set_id(params[i].id);
     }
 
-    if (isValidObstacle(obstacle, frameData->surfaces)) {
-      frameData->obstacles.emplace_back(obstacle);
-    } else {
-      frameData->obstacleParams.erase(std::begin(frameData->obstacleParams) + i);
-    }
+    valid[i] = isValidObstacle(obstacle, frameData->surfaces);
+    obstacles[i] = obstacle;
   }
 
-  // obstacles is in the wrong order because we iterated in reverse
-  std::reverse(std::begin(frameData->obstacles), std::end(frameData->obstacles));
+  // drop the invalid obstacles and their params, keeping the order of the rest
+  frameData->obstacles.clear();
+  frameData->obstacles.reserve(numObstacles);
+  size_t kept = 0;
+  for (int i = 0; i < numObstacles; ++i) {
+    if (valid[i]) {
+      frameData->obstacles.emplace_back(std::move(obstacles[i]));
+      if (kept != static_cast<size_t>(i)) {
+        params[kept] = std::move(params[i]);
+      }
+      ++kept;
+    }
+  }
+  params.erase(params.begin() + kept, params.end());
 
   notifyObservers(frameData);
 }
@@ -20,6 +20,9 @@ public:
    * The method assumes that the given point cloud segment is a single physical
    * object and tries to find the best approximations for this object, using its
    * own specific approximation method, and any hints given in the object_params.
+   *
+   * The obstacles of a frame are approximated in parallel, so implementations
+   * must be safe to call concurrently.
    */
   virtual ObjectModelPtr approximate(ObjectModelParams const& object_params) = 0;
 
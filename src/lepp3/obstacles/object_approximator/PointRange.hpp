@@ -0,0 +1,50 @@
+#ifndef LEPP3_OBJECT_APPROXIMATOR_POINT_RANGE_H__
+#define LEPP3_OBJECT_APPROXIMATOR_POINT_RANGE_H__
+
+#include <memory>
+#include <vector>
+
+#include "lepp3/Typedefs.hpp"
+
+namespace lepp {
+
+/**
+ * A view of a part of a point cloud, given by a range of an index buffer into
+ * the cloud. Without an index buffer, the range covers the points of the cloud
+ * directly.
+ *
+ * All the parts of a split object share the same index buffer, each of them
+ * covering its own section of it, so splitting a part only needs to reorder
+ * the indices within its range instead of copying points.
+ */
+struct PointRange {
+  /**
+   * A range covering all the points of the given cloud.
+   */
+  explicit PointRange(PointCloudConstPtr const& cloud)
+      : cloud(cloud), begin(0), end(cloud->size()) {}
+
+  PointRange(PointCloudConstPtr const& cloud,
+             std::shared_ptr<std::vector<int>> const& indices,
+             size_t begin,
+             size_t end)
+      : cloud(cloud), indices(indices), begin(begin), end(end) {}
+
+  size_t size() const { return end - begin; }
+
+  /**
+   * Returns the i-th point of the range.
+   */
+  PointT const& operator[](size_t i) const {
+    return indices ? (*cloud)[(*indices)[begin + i]] : (*cloud)[begin + i];
+  }
+
+  PointCloudConstPtr cloud;
+  std::shared_ptr<std::vector<int>> indices;
+  size_t begin;
+  size_t end;
+};
+
+}
+
+#endif
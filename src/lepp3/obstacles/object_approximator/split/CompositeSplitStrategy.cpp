@@ -1,6 +1,8 @@
 #include "CompositeSplitStrategy.hpp"
 
-bool lepp::CompositeSplitStrategy::shouldSplit(int split_depth, const PointCloudConstPtr& point_cloud) {
+bool lepp::CompositeSplitStrategy::shouldSplit(int split_depth, const PointRange& points,
+                                               const GeometryDescriptor& geometry,
+                                               const ObjectModelPtr& model) {
   size_t const sz = conditions_.size();
   if (sz == 0) {
     // If there are no conditions, do not split the object, in order to avoid
@@ -10,7 +12,7 @@ bool lepp::CompositeSplitStrategy::shouldSplit(int split_depth, const PointCloud
   }
 
   for (size_t i = 0; i < sz; ++i) {
-    if (!conditions_[i]->shouldSplit(split_depth, point_cloud)) {
+    if (!conditions_[i]->shouldSplit(split_depth, points, geometry, model)) {
       // No split can happen if any of the conditions disallows it.
       return false;
     }
@@ -19,3 +21,12 @@ bool lepp::CompositeSplitStrategy::shouldSplit(int split_depth, const PointCloud
   // Split only if all of the conditions allowed us to split
   return true;
 }
+
+bool lepp::CompositeSplitStrategy::needsModel() const {
+  for (auto const& condition : conditions_) {
+    if (condition->needsModel()) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -22,10 +22,14 @@ public:
     conditions_.push_back(cond);
   }
 
+  bool needsModel() const;
+
 private:
   bool shouldSplit(
       int split_depth,
-      const PointCloudConstPtr& point_cloud);
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model);
 
   /**
    * A list of conditions that will be checked before any split happens.
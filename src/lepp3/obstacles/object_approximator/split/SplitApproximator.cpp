@@ -1,6 +1,9 @@
 #include "SplitApproximator.hpp"
 
 #include <deque>
+#include <numeric>
+
+#include <omp.h>
 
 lepp::SplitObjectApproximator::SplitObjectApproximator(boost::shared_ptr<ObjectApproximator> approx,
                                                        boost::shared_ptr<SplitStrategy> splitter)
@@ -11,54 +14,97 @@ lepp::SplitObjectApproximator::SplitObjectApproximator(boost::shared_ptr<ObjectA
 lepp::ObjectModelPtr lepp::SplitObjectApproximator::approximate(const ObjectModelParams& object_params) {
   boost::shared_ptr<CompositeModel> approx(new CompositeModel);
   approx->set_id(object_params.id);
-  std::deque<std::pair<int, PointCloudPtr> > queue;
-  queue.push_back(std::make_pair(0, object_params.obstacleCloud));
 
-  bool first = true;
-  while (!queue.empty()) {
-    int const depth = queue[0].first;
-    PointCloudPtr const current_cloud = queue[0].second;
-    queue.pop_front();
+  // All parts are ranges of a single index buffer into the object's cloud,
+  // which the splitter reorders in place.
+  std::shared_ptr<std::vector<int>> indices =
+      std::make_shared<std::vector<int>>(object_params.obstacleCloud->size());
+  std::iota(indices->begin(), indices->end(), 0);
 
-    if (current_cloud->size() < 3) {
-      continue;
-    }
+  SplitNode root(0, PointRange(object_params.obstacleCloud, indices, 0, indices->size()));
+  if (omp_in_parallel()) {
+    // the tasks are picked up by the threads of the enclosing team, e.g. the
+    // ones approximating the other objects of the frame
+    evaluate(root, object_params);
+  } else {
+#pragma omp parallel
+#pragma omp single
+    evaluate(root, object_params);
+  }
 
-    ObjectModelParams current_params = object_params;
-    current_params.obstacleCloud = nullptr; current_params.obstacleCloud = current_cloud;
-    current_params.id = 100000 + approx->id() * 1000 + (approx->count()+1);
+  // Collect the approximated parts breadth-first, so that their order and
+  // numbering does not depend on how the tasks were scheduled.
+  std::deque<SplitNode const*> queue;
+  queue.push_back(&root);
+  while (!queue.empty()) {
+    SplitNode const* node = queue.front();
+    queue.pop_front();
 
-    // in case we were given inertial params for the root object, remove them before approximating component
-    // objects (which each have their own inertial parameters that the approximator should estimate)
-    if (!first)
-    {
-        current_params.inertial_axes.clear();
-        current_params.center = Coordinate(std::nan(""), std::nan(""), std::nan(""));
-    }
-    else
-    {
-        first = false;
+    for (auto const& child : node->children) {
+      queue.push_back(child.get());
     }
 
-    // Delegates to the wrapped approximator for each part's approximation.
-    ObjectModelPtr model = approximator_->approximate(current_params);
-
-    // TODO Decide whether the model fits well enough for the current cloud.
-    // For now we fix the number of split iterations.
-    // The approximation should be improved. Try doing it for the split clouds
-    std::vector<PointCloudPtr> const splits = splitter_->split(depth, current_cloud);
-    // Add each new split section into the queue as children of the current
-    // node.
-    if (splits.size() != 0) {
-      for (size_t i = 0; i < splits.size(); ++i) {
-        queue.push_back(std::make_pair(depth + 1, splits[i]));
+    if (node->model) {
+      int const part_id = 100000 + approx->id() * 1000 + (approx->count() + 1);
+      FlattenVisitor flatten;
+      node->model->accept(flatten);
+      for (ObjectModel* part : flatten.objs()) {
+        part->set_id(part_id);
       }
-    } else {
-      // Keep the approximation
-      approx->addModel(model);
+
+      approx->addModel(node->model);
       approx->set_velocity(object_params.velocity);
     }
   }
 
   return approx;
 }
+
+void lepp::SplitObjectApproximator::evaluate(SplitNode& node, ObjectModelParams const& object_params) {
+  if (node.points.size() < 3) {
+    return;
+  }
+
+  // describe the part once for the approximator and the splitter
+  std::shared_ptr<PointRange const> const points = std::make_shared<PointRange>(node.points);
+  std::shared_ptr<GeometryDescriptor const> const geometry = std::make_shared<GeometryDescriptor>(*points);
+
+  ObjectModelParams current_params = object_params;
+  current_params.points = points;
+  current_params.geometry = geometry;
+
+  // in case we were given inertial params for the root object, remove them before approximating component
+  // objects (which each have their own inertial parameters that the approximator should estimate)
+  if (node.depth > 0)
+  {
+      current_params.inertial_axes.clear();
+      current_params.center = Coordinate(std::nan(""), std::nan(""), std::nan(""));
+  }
+
+  // Delegates to the wrapped approximator for each part's approximation. Only
+  // the parts that are kept need one, unless the split conditions get to
+  // judge how well it fits the current part.
+  ObjectModelPtr model;
+  if (splitter_->needsModel()) {
+    model = approximator_->approximate(current_params);
+  }
+
+  std::vector<PointRange> const splits = splitter_->split(node.depth, *points, *geometry, model);
+  if (splits.size() == 0) {
+    // Keep the approximation
+    node.model = model ? model : approximator_->approximate(current_params);
+    return;
+  }
+
+  // The parts are independent, so each of them is evaluated in a task of its
+  // own. They cover disjoint ranges of the index buffer, so the splitter can
+  // safely reorder them concurrently.
+  ObjectModelParams const* params = &object_params;
+  for (size_t i = 0; i < splits.size(); ++i) {
+    node.children.emplace_back(new SplitNode(node.depth + 1, splits[i]));
+    SplitNode* child = node.children.back().get();
+#pragma omp task
+    evaluate(*child, *params);
+  }
+#pragma omp taskwait
+}
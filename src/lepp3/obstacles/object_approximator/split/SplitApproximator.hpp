@@ -25,9 +25,34 @@ public:
         boost::shared_ptr<ObjectApproximator > approx,
         boost::shared_ptr<SplitStrategy> splitter);
 
+  /**
+   * Approximates the object by recursively splitting it. The parts of the
+   * split tree are evaluated as parallel tasks, but the resulting parts are
+   * always ordered breadth-first, as is their numbering.
+   */
   ObjectModelPtr approximate(
       const ObjectModelParams& object_params);
 private:
+  /**
+   * A node of the split tree: a part of the object that is either split
+   * further into its children or approximated by its own model.
+   */
+  struct SplitNode {
+    SplitNode(int depth, PointRange const& points) : depth(depth), points(points) {}
+
+    int const depth;
+    PointRange const points;
+    ObjectModelPtr model;
+    std::vector<std::unique_ptr<SplitNode>> children;
+  };
+
+  /**
+   * Approximates the given node and keeps the approximation, unless the node
+   * should be split, in which case its children are evaluated in parallel
+   * tasks. Returns once the whole subtree of the node has been evaluated.
+   */
+  void evaluate(SplitNode& node, ObjectModelParams const& object_params);
+
   /**
    * An `ObjectApproximator` used to generate approximations for object parts.
    */
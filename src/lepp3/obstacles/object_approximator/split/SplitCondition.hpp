@@ -2,6 +2,8 @@
 #define LEPP3_OBJECT_APPROXIMATOR_SPLIT_SPLIT_CONDITION_H__
 
 #include "lepp3/Typedefs.hpp"
+#include "lepp3/models/ObjectModel.h"
+#include "lepp3/obstacles/object_approximator/GeometryDescriptor.hpp"
 
 namespace lepp {
 
@@ -17,13 +19,24 @@ public:
    *
    * :param split_depth: The current split depth, i.e. the number of times the
    *     original cloud has already been split
-   * :param point_cloud: The current point cloud that should be split by the
-   *    `SplitStrategy` implementation.
+   * :param points: The points of the current part that should be split by
+   *    the `SplitStrategy` implementation.
+   * :param geometry: The geometry of the current part.
+   * :param model: The approximation of the current part, if the condition
+   *    `needsModel`; null otherwise.
    * :returns: A boolean indicating whether the cloud should be split or not.
    */
   virtual bool shouldSplit(
       int split_depth,
-      const PointCloudConstPtr& point_cloud) = 0;
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model) = 0;
+
+  /**
+   * Whether the condition judges the approximation of the part, which then
+   * has to be made before deciding on the split, even if it is split.
+   */
+  virtual bool needsModel() const { return false; }
 };
 
 }
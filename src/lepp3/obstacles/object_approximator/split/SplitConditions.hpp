@@ -3,7 +3,11 @@
 
 #include "SplitCondition.hpp"
 
-#include <pcl/common/pca.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
 
 #include "lepp3/models/Coordinate.h"
 
@@ -19,7 +23,9 @@ public:
 
   bool shouldSplit(
       int split_depth,
-      const PointCloudConstPtr& point_cloud) {
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model) {
     return split_depth < limit_;
   }
 
@@ -42,15 +48,12 @@ public:
 
   bool shouldSplit(
       int split_depth,
-      const PointCloudConstPtr& point_cloud) {
-    // Find the limits of the bounding box of the cloud
-    PointT min_pt;
-    PointT max_pt;
-    pcl::getMinMax3D(*point_cloud, min_pt, max_pt);
-
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model) {
     // Calculate the volume of the box bounded by those two points.
     // Make sure the units are centimeters.
-    Coordinate const sz = 100 * (Coordinate(max_pt) - Coordinate(min_pt));
+    Coordinate const sz = 100 * Coordinate(Eigen::Vector3f(geometry.max - geometry.min));
     int const volume = static_cast<int>(
         (sz.x * sz.x * sz.x) + (sz.y * sz.y * sz.y) + (sz.z * sz.z * sz.z));
 
@@ -79,14 +82,12 @@ public:
 
   bool shouldSplit(
       int split_depth,
-      const PointCloudConstPtr& point_cloud) {
-    float major_value, middle_value, minor_value;
-    pcl::PCA<PointT> pca;
-    pca.setInputCloud(point_cloud);
-    Eigen::Vector3f eigenvalues = pca.getEigenValues();
-    major_value = eigenvalues(0);
-    middle_value = eigenvalues(1);
-    minor_value = eigenvalues(2);
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model) {
+    float const major_value = geometry.eigenvalues(0);
+    float const middle_value = geometry.eigenvalues(1);
+    float const minor_value = geometry.eigenvalues(2);
 
     if ((middle_value / major_value > sphere1) && (minor_value / major_value > sphere2)) {
       // This is very much a sphere, so we don't split it any more.
@@ -109,6 +110,158 @@ private:
   double capsule;
 };
 
+/**
+ * A `SplitCondition` that allows the split to be made only if the current
+ * approximation fits the object badly, so that no effort (and no additional
+ * primitives) is spent on parts that are already tightly approximated.
+ *
+ * The fit error is the fraction of the visible surface of the approximation
+ * that is not supported by the object's points, measured on a coarse voxel
+ * grid: a voxel is enclosed if its center lies inside one of the primitives,
+ * and it is on the visible surface if the next voxel towards the sensor (the
+ * sensor origin of the cloud) is not enclosed. The sensor only ever sees that
+ * surface, so the enclosed voxels behind it are not judged. A voxel is
+ * supported if it or any of its neighbors contains a point.
+ *
+ * The condition does not limit the depth of the split tree: parts that are
+ * never approximated well enough are split until they have too few points.
+ * It should be combined with a `DepthLimitSplitCondition`.
+ */
+class FitErrorSplitCondition : public SplitCondition {
+public:
+  /**
+   * Creates a new `FitErrorSplitCondition` that allows splits of objects whose
+   * fit error is larger than `max_error` (a fraction between 0 and 1), using
+   * voxels of the given size (in **meters**).
+   */
+  FitErrorSplitCondition(double voxel_size, double max_error)
+      : voxel_size_(voxel_size), max_error_(max_error) {}
+
+  bool shouldSplit(
+      int split_depth,
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model) {
+    return fitError(points, model) > max_error_;
+  }
+
+  bool needsModel() const { return true; }
+
+  /**
+   * Returns the fraction of the voxels on the surface of the model facing the
+   * sensor that are not supported by any of the given points.
+   */
+  double fitError(const PointRange& points, const ObjectModelPtr& model) const {
+    std::unordered_set<int64_t> occupied;
+    occupied.reserve(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+      Eigen::Vector3f const p = points[i].getVector3fMap() / voxel_size_;
+      occupied.insert(voxelKey(std::floor(p.x()), std::floor(p.y()), std::floor(p.z())));
+    }
+
+    EnclosedVoxels enclosed(voxel_size_);
+    model->accept(enclosed);
+    if (enclosed.voxels().empty()) {
+      return 0.;
+    }
+
+    Eigen::Vector3f const sensor = points.cloud->sensor_origin_.head<3>() / voxel_size_;
+    size_t visible = 0;
+    size_t unsupported = 0;
+    for (Eigen::Vector3i const& voxel : enclosed.voxels()) {
+      // one voxel step towards the sensor
+      Eigen::Vector3f const towards = (sensor - (voxel.cast<float>().array() + .5f).matrix()).normalized();
+      Eigen::Vector3i const step = towards.array().round().cast<int>();
+      if (enclosed.contains(voxel + step)) {
+        continue;
+      }
+      ++visible;
+      if (!isSupported(voxel, occupied)) {
+        ++unsupported;
+      }
+    }
+    return visible > 0 ? static_cast<double>(unsupported) / visible : 0.;
+  }
+
+private:
+  static int64_t voxelKey(int64_t x, int64_t y, int64_t z) {
+    int64_t const mask = (int64_t(1) << 21) - 1;
+    return ((x & mask) << 42) | ((y & mask) << 21) | (z & mask);
+  }
+
+  static bool isSupported(Eigen::Vector3i const& voxel, std::unordered_set<int64_t> const& occupied) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dz = -1; dz <= 1; ++dz) {
+          if (occupied.count(voxelKey(voxel.x() + dx, voxel.y() + dy, voxel.z() + dz))) {
+            return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Collects the voxels whose centers lie inside any of the primitives of the
+   * visited model.
+   */
+  class EnclosedVoxels : public ModelVisitor {
+  public:
+    EnclosedVoxels(double voxel_size) : voxel_size_(voxel_size) {}
+
+    void visitSphere(SphereModel& sphere) {
+      Coordinate const c = sphere.center_point();
+      Eigen::Vector3d const center(c.x, c.y, c.z);
+      double const r = sphere.radius();
+      addVoxels(center, center, r);
+    }
+
+    void visitCapsule(CapsuleModel& capsule) {
+      Eigen::Vector3d const first(capsule.first().x, capsule.first().y, capsule.first().z);
+      Eigen::Vector3d const second(capsule.second().x, capsule.second().y, capsule.second().z);
+      addVoxels(first, second, capsule.radius());
+    }
+
+    std::vector<Eigen::Vector3i> const& voxels() const { return voxels_; }
+    bool contains(Eigen::Vector3i const& voxel) const {
+      return seen_.count(voxelKey(voxel.x(), voxel.y(), voxel.z())) != 0;
+    }
+
+  private:
+    /**
+     * Adds the voxels within the given radius of the segment between the two
+     * points (which may coincide, giving a sphere).
+     */
+    void addVoxels(Eigen::Vector3d const& a, Eigen::Vector3d const& b, double r) {
+      Eigen::Vector3d const ab = b - a;
+      double const length_squared = ab.squaredNorm();
+      Eigen::Vector3i const lo = ((a.cwiseMin(b).array() - r) / voxel_size_).floor().cast<int>();
+      Eigen::Vector3i const hi = ((a.cwiseMax(b).array() + r) / voxel_size_).floor().cast<int>();
+      for (int x = lo.x(); x <= hi.x(); ++x) {
+        for (int y = lo.y(); y <= hi.y(); ++y) {
+          for (int z = lo.z(); z <= hi.z(); ++z) {
+            Eigen::Vector3d const p = (Eigen::Vector3d(x, y, z).array() + .5) * voxel_size_;
+            double t = length_squared > 0 ? (p - a).dot(ab) / length_squared : 0.;
+            t = std::min(std::max(t, 0.), 1.);
+            if ((a + t * ab - p).squaredNorm() <= r * r
+                && seen_.insert(voxelKey(x, y, z)).second) {
+              voxels_.push_back(Eigen::Vector3i(x, y, z));
+            }
+          }
+        }
+      }
+    }
+
+    double const voxel_size_;
+    std::unordered_set<int64_t> seen_;
+    std::vector<Eigen::Vector3i> voxels_;
+  };
+
+  double const voxel_size_;
+  double const max_error_;
+};
+
 }
 
 #endif
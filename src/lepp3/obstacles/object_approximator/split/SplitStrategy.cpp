@@ -1,28 +1,25 @@
 #include "SplitStrategy.hpp"
 
-#include <pcl/common/pca.h>
-
-std::vector<lepp::PointCloudPtr> lepp::SplitStrategy::split(int split_depth, const PointCloudConstPtr& point_cloud) {
-  if (this->shouldSplit(split_depth, point_cloud)) {
-    return this->doSplit(point_cloud);
+#include <algorithm>
+#include <numeric>
+
+std::vector<lepp::PointRange> lepp::SplitStrategy::split(int split_depth, const PointRange& points,
+                                                         const GeometryDescriptor& geometry,
+                                                         const ObjectModelPtr& model) {
+  if (this->shouldSplit(split_depth, points, geometry, model)) {
+    return this->doSplit(points, geometry);
   } else {
-    return std::vector<PointCloudPtr>();
+    return std::vector<PointRange>();
   }
 }
 
-std::vector<lepp::PointCloudPtr> lepp::SplitStrategy::doSplit(const PointCloudConstPtr& point_cloud) {
-  // Compute PCA for the input cloud
-  pcl::PCA<PointT> pca;
-  pca.setInputCloud(point_cloud);
-  Eigen::Vector3f eigenvalues = pca.getEigenValues();
-  Eigen::Matrix3f eigenvectors = pca.getEigenVectors();
-
-  Eigen::Vector3d main_pca_axis = eigenvectors.col(static_cast<int>(axis_))
+std::vector<lepp::PointRange> lepp::SplitStrategy::doSplit(const PointRange& points,
+                                                           const GeometryDescriptor& geometry) {
+  // The cloud is split by the plane through its centroid perpendicular to
+  // the chosen principal axis.
+  Eigen::Vector3d main_pca_axis = geometry.eigenvectors.col(static_cast<int>(axis_))
       .cast<double>();
-
-  // Compute the centroid
-  Eigen::Vector4d centroid;
-  pcl::compute3DCentroid(*point_cloud, centroid);
+  Eigen::Vector3d const centroid = geometry.centroid.cast<double>();
 
   /// The plane equation
   double d = (-1) * (
@@ -31,30 +28,33 @@ std::vector<lepp::PointCloudPtr> lepp::SplitStrategy::doSplit(const PointCloudCo
       centroid[2] * main_pca_axis[2]
   );
 
-  // Prepare the two parts.
-  std::vector<PointCloudPtr> ret;
-  ret.push_back(PointCloudPtr(new PointCloudT()));
-  ret.push_back(PointCloudPtr(new PointCloudT()));
-  PointCloudT& first = *ret[0];
-  PointCloudT& second = *ret[1];
-
-  // Now divide the input cloud into two clusters based on the splitting plane
-  size_t const sz = point_cloud->size();
-  for (size_t i = 0; i < sz; ++i) {
-    // Boost the precision of the points we are dealing with to make the
-    // calculation more precise.
-    PointT const& original_point = (*point_cloud)[i];
-    Eigen::Vector3f const vector_point = original_point.getVector3fMap();
-    Eigen::Vector3d const point = vector_point.cast<double>();
-    // Decide on which side of the plane the current point is and add it to the
-    // appropriate partition.
-    if (point.dot(main_pca_axis) + d < 0.) {
-      first.push_back(original_point);
-    } else {
-      second.push_back(original_point);
-    }
+  // Partition the indices of the range in place, so that the points on the
+  // negative side of the plane come first, followed by the ones on the positive
+  // side. Parts of a range without an index buffer get one of their own.
+  std::shared_ptr<std::vector<int>> indices = points.indices;
+  size_t begin = points.begin;
+  size_t end = points.end;
+  if (!indices) {
+    indices = std::make_shared<std::vector<int>>(points.size());
+    std::iota(indices->begin(), indices->end(), static_cast<int>(points.begin));
+    begin = 0;
+    end = indices->size();
   }
 
+  PointCloudT const& cloud = *points.cloud;
+  auto const middle = std::partition(
+      indices->begin() + begin, indices->begin() + end,
+      [&](int index) {
+        // Boost the precision of the points we are dealing with to make the
+        // calculation more precise.
+        Eigen::Vector3d const point = cloud[index].getVector3fMap().cast<double>();
+        return point.dot(main_pca_axis) + d < 0.;
+      });
+  size_t const split = middle - indices->begin();
+
   // Return the parts in a vector, as expected by the interface...
+  std::vector<PointRange> ret;
+  ret.push_back(PointRange(points.cloud, indices, begin, split));
+  ret.push_back(PointRange(points.cloud, indices, split, end));
   return ret;
 }
@@ -4,6 +4,9 @@
 #include <vector>
 
 #include "lepp3/Typedefs.hpp"
+#include "lepp3/models/ObjectModel.h"
+#include "lepp3/obstacles/object_approximator/GeometryDescriptor.hpp"
+#include "lepp3/obstacles/object_approximator/PointRange.hpp"
 
 namespace lepp {
 
@@ -45,17 +48,29 @@ public:
    *
    * :param split_depth: The current split depth, i.e. the number of times the
    *     original cloud has already been split
-   * :param point_cloud: The current point cloud that should be split by the
-   *    `SplitStrategy` implementation.
-   * :returns: The method should return a vector of point clouds obtained by
-   *      splitting the given cloud into any number of parts. If the given
-   *      point cloud should not be split, an empty vector should be returned.
+   * :param points: The points of the current part that should be split by
+   *    the `SplitStrategy` implementation.
+   * :param geometry: The geometry of the current part.
+   * :param model: The approximation of the current part, if the strategy
+   *    `needsModel`; null otherwise.
+   * :returns: The method should return a vector of point ranges obtained by
+   *      splitting the given part into any number of parts. If the given
+   *      part should not be split, an empty vector should be returned.
    *      Once the empty vector is returned, the `SplitObjectApproximator` will
    *      stop the splitting process for that branch of the split tree.
    */
-  virtual std::vector <PointCloudPtr> split(
+  virtual std::vector<PointRange> split(
       int split_depth,
-      const PointCloudConstPtr& point_cloud);
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model);
+
+  /**
+   * Whether the strategy judges the approximation of the part, which then has
+   * to be made before deciding on the split. Otherwise, only the parts that
+   * are not split any further are approximated.
+   */
+  virtual bool needsModel() const { return false; }
 
 protected:
   /**
@@ -64,21 +79,30 @@ protected:
    *
    * :param split_depth: The current split depth, i.e. the number of times the
    *     original cloud has already been split
-   * :param point_cloud: The current point cloud that should be split by the
-   *    `SplitStrategy` implementation.
+   * :param points: The points of the current part that should be split by
+   *    the `SplitStrategy` implementation.
+   * :param geometry: The geometry of the current part.
+   * :param model: The approximation of the current part, if the strategy
+   *    `needsModel`; null otherwise.
    * :returns: A boolean indicating whether the cloud should be split or not.
    */
   virtual bool shouldSplit(
       int split_depth,
-      const PointCloudConstPtr& point_cloud) = 0;
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model) = 0;
 
   /**
    * A helper method that does the actual split, when needed.
    * A default implementation is provided, since that is what most splitters
    * will want to use...
+   *
+   * The default implementation reorders the indices of the given range in
+   * place, so that the two parts it returns are adjacent sections of it.
    */
-  virtual std::vector <PointCloudPtr> doSplit(
-      const PointCloudConstPtr& point_cloud);
+  virtual std::vector<PointRange> doSplit(
+      const PointRange& points,
+      const GeometryDescriptor& geometry);
 
 private:
   SplitAxis axis_;
@@ -1,21 +1,10 @@
 #include "EuclideanSegmenter.hpp"
 
-lepp::EuclideanSegmenter::EuclideanSegmenter(double min_filter_percentage)
-    : kd_tree_(new pcl::search::KdTree<PointT>()),
-      min_filter_percentage_(min_filter_percentage) {
-
-  // Parameter initialization of the plane segmentation
-  segmentation_.setOptimizeCoefficients(true);
-  segmentation_.setModelType(pcl::SACMODEL_PLANE);
-  segmentation_.setMethodType(pcl::SAC_RANSAC);
-  segmentation_.setMaxIterations(100);
-  segmentation_.setDistanceThreshold(0.05); //0.05
-
-  // Parameter initialization of the clusterizer
-  clusterizer_.setClusterTolerance(0.03); //0.03
-  clusterizer_.setMinClusterSize(100);
-  clusterizer_.setMaxClusterSize(25000);
-}
+#include <pcl/common/io.h>
+
+lepp::EuclideanSegmenter::EuclideanSegmenter(Parameters const& params)
+    : clusterizer_(params.clusterTolerance, params.toleranceRangeFactor,
+                   params.minClusterSize, params.maxClusterSize) {}
 
 std::vector<lepp::ObjectModelParams> lepp::EuclideanSegmenter::extractObstacleParams(PointCloudConstPtr cloud) {
   std::vector<pcl::PointIndices> cluster_indices = getClusters(cloud);
@@ -24,11 +13,8 @@ std::vector<lepp::ObjectModelParams> lepp::EuclideanSegmenter::extractObstaclePa
 
 std::vector<pcl::PointIndices> lepp::EuclideanSegmenter::getClusters(PointCloudConstPtr const& cloud_filtered) {
   // Extract the clusters from such a filtered cloud.
-  kd_tree_->setInputCloud(cloud_filtered);
-  clusterizer_.setSearchMethod(kd_tree_);
-  clusterizer_.setInputCloud(cloud_filtered);
   std::vector<pcl::PointIndices> cluster_indices;
-  clusterizer_.extract(cluster_indices);
+  clusterizer_.extract(*cloud_filtered, cluster_indices);
 
   return cluster_indices;
 }
@@ -42,12 +28,8 @@ lepp::EuclideanSegmenter::clustersToPointClouds(PointCloudConstPtr const& cloud_
   size_t const cluster_count = cluster_indices.size();
   for (size_t i = 0; i < cluster_count; ++i) {
     PointCloudPtr current(new PointCloudT());
-    std::vector<int> const& curr_indices = cluster_indices[i].indices;
-    size_t const curr_indices_sz = curr_indices.size();
-    for (size_t j = 0; j < curr_indices_sz; ++j) {
-      // add the point to the corresponding point cloud
-      current->push_back(cloud_filtered->at(curr_indices[j]));
-    }
+    // copies all points of the cluster at once, without growing the cloud point by point
+    pcl::copyPointCloud(*cloud_filtered, cluster_indices[i].indices, *current);
 
     ret.push_back(ObjectModelParams(current));
     ret.back().id = i + 1; // object IDs start at 1
@@ -3,17 +3,26 @@
 
 #include "lepp3/Typedefs.hpp"
 #include "lepp3/obstacles/segmenter/Segmenter.hpp"
-
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/segmentation/extract_clusters.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/filters/voxel_grid.h>
+#include "lepp3/util/EuclideanClusterGrid.h"
 
 namespace lepp {
 
 class EuclideanSegmenter : public ObstacleSegmenter {
 public:
-  EuclideanSegmenter(double min_filter_percentage);
+  struct Parameters {
+    // maximum distance between neighboring points of a cluster, in meters
+    double clusterTolerance = 0.03;
+    // the tolerance grows by this factor times the squared range of the points (their distance
+    // to the sensor origin of the cloud, in 1/m), since the depth noise of the sensor grows
+    // quadratically with the range, up to EuclideanClusterGrid::MAX_TOLERANCE_RATIO times the
+    // tolerance. 0 disables it
+    double toleranceRangeFactor = 0.0;
+    // clusters with fewer or more points are dropped
+    int minClusterSize = 100;
+    int maxClusterSize = 25000;
+  };
+
+  EuclideanSegmenter(Parameters const& params);
 
 private:
   virtual std::vector<ObjectModelParams> extractObstacleParams(PointCloudConstPtr cloud) override;
@@ -37,28 +46,12 @@ private:
       std::vector<pcl::PointIndices> const& cluster_indices);
 
 
-  /**
-   * Instance used to extract the planes from the input cloud.
-   */
-  pcl::SACSegmentation<PointT> segmentation_;
   /**
    * Instance used to extract the actual clusters from the input cloud.
+   * Works on a voxel grid instead of a KdTree, which would need to be rebuilt
+   * for every frame.
    */
-  pcl::EuclideanClusterExtraction<PointT> clusterizer_;
-  /**
-   * The KdTree will hold the representation of the point cloud which is passed
-   * to the clusterizer.
-   */
-  boost::shared_ptr<pcl::search::KdTree<PointT> > kd_tree_;
-
-  /**
-   * The percentage of the original cloud that should be kept for the
-   * clusterization, at the least.
-   * We stop removing planes from the original cloud once there are either no
-   * more planes to be removed or when the number of points remaining in the
-   * cloud dips below this percentage of the original cloud.
-   */
-  double const min_filter_percentage_;
+  util::EuclideanClusterGrid clusterizer_;
 };
 
 }
@@ -27,6 +27,9 @@ struct SegmenterParameters {
   float splitMaxOtherStatesPercentage = 0.2f;
   // how much of the observation covariance is taken from the previous frame
   float obsCovarRegularization = 0.95f;
+  // maximum number of points the EM steps are run on; larger clouds are subsampled (stratified per vcluster)
+  // and only the final hard assignment runs over all points. 0 disables subsampling
+  int emSubsampleSize = 0;
   // minimum number of frames an obstacle must be observed in to count as 'real'
   int minPersistentFrames = 1;
   // approx. density of obstacles to consider them good enough to use (in points / meter,
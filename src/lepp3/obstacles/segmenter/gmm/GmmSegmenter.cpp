@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numeric>
 
 #include "deps/easylogging++.h"
 
@@ -28,6 +30,7 @@ float probability_density_function(const lepp::GMM::State& state, const Eigen::V
 lepp::GmmSegmenter::GmmSegmenter(const GMM::SegmenterParameters& params) : parameters_(params),
                                                                            voxel_grid_(params.voxelGridResolution),
                                                                            initialized_(false),
+                                                                           em_sample_ratio_(1.0f),
                                                                            kalmanFilter_(params.kalman_PositionNoise,
                                                                                          params.kalman_VelocityNoise,
                                                                                          params.kalman_MeasurementNoise)
@@ -60,13 +63,30 @@ std::vector<lepp::ObjectModelParams> lepp::GmmSegmenter::extractObstacleParams(P
     }
   }
 
-  if (N > vcluster_point_table.size())
+  if (N > vcluster_point_table.size()) {
     vcluster_point_table.resize(N);
+    point_state_label.resize(N);
+  }
   if (states_.size() > state_main_vcluster.size())
     state_main_vcluster.resize(states_.size());
 
+  // on large clouds, fit the states on a stratified subsample only
+  PointCloudT sample;
+  PointCloudT const* em_cloud = cloud.get();
+  const bool subsampled = parameters_.emSubsampleSize > 0 && N > static_cast<size_t>(parameters_.emSubsampleSize);
+  if (subsampled) {
+    subsample(*cloud, sample);
+    em_cloud = &sample;
+  }
+  const size_t M = em_cloud->size(); // number of points used for EM
+  em_sample_ratio_ = static_cast<float>(M) / N;
+  if (M > vcluster_sample_table.size()) {
+    vcluster_sample_table.resize(M);
+    sample_state_label.resize(M);
+  }
+
   // R(i,j) = "responsibility" of state j for point i
-  MatrixXf R(N, states_.size());
+  MatrixXf R(M, states_.size());
   // C(i,j) = points of state j that are in vcluster i (assuming a hard point-state assignment of sorts)
   MatrixXi C = MatrixXi::Zero(voxel_grid_.numClusters(), states_.size());
 
@@ -76,7 +96,9 @@ std::vector<lepp::ObjectModelParams> lepp::GmmSegmenter::extractObstacleParams(P
 
   VectorXi VCPointCounts = VectorXi::Zero(voxel_grid_.numClusters()); // general vcluster point count
 
-  e_step(cloud.get(), R, C, VCMeans, VCSM, VCPointCounts);
+  e_step(em_cloud, R, C, VCMeans, VCSM, VCPointCounts,
+         subsampled ? vcluster_sample_table : vcluster_point_table,
+         subsampled ? sample_state_label : point_state_label);
 
   // total responsibilities for states
   const VectorXf rks = R.colwise().sum();
@@ -87,7 +109,7 @@ std::vector<lepp::ObjectModelParams> lepp::GmmSegmenter::extractObstacleParams(P
   std::vector<int> removedStates; // indices of states that should be removed
   // remove states with low mixing coefficients, indicating that they don't hold any significant probability over points
   for (size_t k = 0; k < states_.size(); k++) {
-    if (rks(k) / N < parameters_.statePiRemovalThreshold) {
+    if (rks(k) / M < parameters_.statePiRemovalThreshold) {
       // need to defer the removal if we want to avoid recomputing all of the above
       removedStates.push_back(k);
     }
@@ -99,7 +121,7 @@ std::vector<lepp::ObjectModelParams> lepp::GmmSegmenter::extractObstacleParams(P
 
     for (int i = 0; i < vcpoints.size(); i++) {
       // got points that are already covered by a state or don't have enough points? ignore!
-      if (vcpoints[i] > 0 || VCPointCounts[i] < parameters_.minVclusterPoints)
+      if (vcpoints[i] > 0 || VCPointCounts[i] < parameters_.minVclusterPoints * em_sample_ratio_)
         continue;
 
       const Vector4f vcmean = VCMeans.col(i);
@@ -119,11 +141,34 @@ std::vector<lepp::ObjectModelParams> lepp::GmmSegmenter::extractObstacleParams(P
     }
   }
 
-  m_step(cloud.get(), R, C, rks, cks, newStates, removedStates);
+  m_step(em_cloud, R, C, rks, cks, newStates, removedStates);
+
+  if (subsampled) {
+    // EM only saw the subsample, so assign every point using the updated states
+    hardAssign(cloud.get(), point_state_label);
+  }
+
+  const size_t K = states_.size();
+
+  // keep the hard assignments of points to persistent states which lie in a vcluster "owned" by the state
+  std::vector<size_t> stateCounts(K, 0);
+  for (size_t i = 0; i < N; i++) {
+    const int k = point_state_label[i];
+    if (k < 0)
+      continue;
+
+    const int vcluster = vcluster_point_table[i];
+    if (states_[k].lifeTime < parameters_.minPersistentFrames
+        || (vcluster != state_main_vcluster[k] && C(vcluster, k) <= parameters_.numSplitPoints * em_sample_ratio_)) {
+      point_state_label[i] = -1;
+    } else {
+      ++stateCounts[k];
+    }
+  }
 
   // Prepare results
   std::vector<ObjectModelParams> ret;
-  for (size_t i = 0; i < states_.size(); ++i) {
+  for (size_t i = 0; i < K; ++i) {
     ret.emplace_back(boost::make_shared<PointCloudT>());
     ret.back().id = i+1; // obstacle ids start at 1
     ret.back().center = states_[i].pos;
@@ -133,37 +178,37 @@ std::vector<lepp::ObjectModelParams> lepp::GmmSegmenter::extractObstacleParams(P
     const Matrix3f evecs = eigensolver.eigenvectors();
     ret.back().inertial_values = eigensolver.eigenvalues().reverse(); // reversed b/c approximators expect these to be in descending order
     ret.back().inertial_axes = {evecs.col(2), evecs.col(1), evecs.col(0)};
+
+    ret.back().obstacleCloud->resize(stateCounts[i]);
+    ret.back().obstacleCloud->sensor_origin_ = cloud->sensor_origin_;
   }
 
+  // scatter the points into the preallocated obstacle clouds (counting sort by state),
+  // accumulating the bounding box of each obstacle along the way
+  std::vector<size_t> stateCursors(K, 0);
+  std::vector<Vector3f> minPts(K, Vector3f::Constant(std::numeric_limits<float>::max()));
+  std::vector<Vector3f> maxPts(K, Vector3f::Constant(-std::numeric_limits<float>::max()));
   for (size_t i = 0; i < N; i++) {
-    for (size_t k = 0; k < states_.size(); ++k) {
-      if (states_[k].lifeTime < parameters_.minPersistentFrames)
-          continue;
-      else if (R(i, k) > parameters_.hardAssignmentStateResp
-              && (vcluster_point_table[i] == state_main_vcluster[k]
-              || C(vcluster_point_table[i], k) > parameters_.numSplitPoints))
-      {
-        ret[k].obstacleCloud->push_back((*cloud)[i]);
-        break;
-      }
-    }
+    const int k = point_state_label[i];
+    if (k < 0)
+      continue;
+
+    const PointT& pt = (*cloud)[i];
+    (*ret[k].obstacleCloud)[stateCursors[k]++] = pt;
+    minPts[k] = minPts[k].cwiseMin(pt.getVector3fMap());
+    maxPts[k] = maxPts[k].cwiseMax(pt.getVector3fMap());
   }
 
   // remove obstacle clouds that have too low a density
   for (size_t i = 0; i < ret.size(); i++)
   {
-    PointT min_pt;
-    PointT max_pt;
-    pcl::getMinMax3D(*ret[i].obstacleCloud, min_pt, max_pt);
-    auto diagonal_len = (Eigen::Vector3d(max_pt.x, max_pt.y, max_pt.z) - Eigen::Vector3d(min_pt.x, min_pt.y, min_pt.z)).norm();
-    auto density = (double)ret[i].obstacleCloud->size() / diagonal_len;
-    if (density > 0) {
-        std::cout << "Density of state " << i << ": " << density << std::endl;
-        std::cout << "\tDiagonal: " << diagonal_len << std::endl;
-    }
+    if (stateCounts[i] == 0)
+      continue;
+
+    const double diagonal_len = (maxPts[i] - minPts[i]).cast<double>().norm();
+    const double density = stateCounts[i] / diagonal_len;
     if (density < parameters_.obstacleDensity)
     {
-      std::cout << "Clearing cloud " << i << std::endl;
       ret[i].obstacleCloud->clear();
     }
   }
@@ -192,9 +237,6 @@ std::vector<lepp::ObjectModelParams> lepp::GmmSegmenter::extractObstacleParams(P
     GMM::GMMDataSubject::notifyObservers_Update(states_[i], i);
   }
 
-  if (parameters_.enableKalmanFilter)
-    kalmanFilter_.update(ret);
-
 #ifdef LEPP3_ENABLE_TRACING
   tracepoint(lepp3_trace_provider, gmm_frame_end);
 #endif
@@ -226,9 +268,81 @@ void lepp::GmmSegmenter::initialize(const PointCloudT* pc) {
   }
 }
 
+void lepp::GmmSegmenter::subsample(PointCloudT const& pc, PointCloudT& out) {
+  const auto map = pc.getMatrixXfMap();
+  const size_t N = pc.size(); // number of points
+  const size_t numClusters = voxel_grid_.numClusters();
+
+  // bucket the point indices by vcluster (counting sort)
+  std::vector<size_t> offsets(numClusters + 1, 0);
+  for (size_t i = 0; i < N; i++) {
+    const Eigen::Vector4f x = map.col(i);
+    const int vcluster = voxel_grid_.clusterForPoint(x);
+    vcluster_point_table[i] = vcluster;
+    ++offsets[vcluster + 1];
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  std::vector<size_t> order(N);
+  {
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < N; i++) {
+      order[next[vcluster_point_table[i]]++] = i;
+    }
+  }
+
+  // each vcluster contributes in proportion to its size, but at least one point,
+  // so that small obstacles are still represented in the subsample
+  const float ratio = static_cast<float>(parameters_.emSubsampleSize) / N;
+  out.clear();
+  out.reserve(parameters_.emSubsampleSize + numClusters);
+  for (size_t c = 0; c < numClusters; c++) {
+    const size_t begin = offsets[c];
+    const size_t count = offsets[c + 1] - begin;
+    const size_t quota = std::min(count, std::max<size_t>(1, std::lround(count * ratio)));
+
+    // partial Fisher-Yates shuffle: draw quota points of the vcluster without replacement
+    for (size_t j = 0; j < quota; j++) {
+      std::uniform_int_distribution<size_t> dist(j, count - 1);
+      std::swap(order[begin + j], order[begin + dist(rng_)]);
+      out.push_back(pc[order[begin + j]]);
+    }
+  }
+}
+
+void lepp::GmmSegmenter::hardAssign(PointCloudT const* pc, std::vector<int>& stateLabels) const {
+  using namespace Eigen;
+
+  const auto map = pc->getMatrixXfMap();
+  const size_t N = pc->size(); // number of points
+  const size_t K = states_.size();
+
+  VectorXf weighted(K);
+  for (size_t i = 0; i < N; i++) {
+    const Vector4f x = map.col(i);
+
+    float normalizer = 0.0f;
+    for (size_t k = 0; k < K; k++) {
+      weighted(k) = states_[k].validObsCovar ? states_[k].pi * probability_density_function(states_[k], x) : 0.0f;
+      normalizer += weighted(k);
+    }
+
+    stateLabels[i] = -1;
+    if (normalizer > 0.001f) {
+      for (size_t k = 0; k < K; k++) {
+        if (weighted(k) / normalizer > parameters_.hardAssignmentStateResp) {
+          stateLabels[i] = k;
+          break;
+        }
+      }
+    }
+  }
+}
+
 void lepp::GmmSegmenter::e_step(PointCloudT const* pc, Eigen::MatrixXf& R, Eigen::MatrixXi& C,
                                 Eigen::Matrix4Xf& VCMeans, std::vector<Eigen::Matrix4f>& VCSM,
-                                Eigen::VectorXi& VCPointCounts) {
+                                Eigen::VectorXi& VCPointCounts, std::vector<int>& vclusterTable,
+                                std::vector<int>& stateLabels) {
   using namespace Eigen;
 
   const auto map = pc->getMatrixXfMap();
@@ -252,6 +366,7 @@ void lepp::GmmSegmenter::e_step(PointCloudT const* pc, Eigen::MatrixXf& R, Eigen
     }
 #endif
 
+    stateLabels[i] = -1;
     for (size_t k = 0; k < states_.size(); k++) {
       if (normalizer > 0.001f) {
         R(i, k) = states_[k].pi * probability_density_function(states_[k], x) / normalizer;
@@ -259,6 +374,8 @@ void lepp::GmmSegmenter::e_step(PointCloudT const* pc, Eigen::MatrixXf& R, Eigen
         if (R(i, k) > parameters_.hardAssignmentStateResp) {
           // this point likely "belongs" to state k, add contribution of state to vcluster of point
           ++C(vcluster, k);
+          if (stateLabels[i] < 0)
+            stateLabels[i] = k;
         }
       } else {
         // this point has not enough probability support from any state - ignore it entirely
@@ -279,7 +396,7 @@ void lepp::GmmSegmenter::e_step(PointCloudT const* pc, Eigen::MatrixXf& R, Eigen
       VCSM[vcluster] += x * x.transpose();
     }
     // cache vcluster for point
-    vcluster_point_table[i] = vcluster;
+    vclusterTable[i] = vcluster;
   }
 }
 
@@ -315,7 +432,8 @@ void lepp::GmmSegmenter::m_step(PointCloudT const* pc, Eigen::MatrixXf const& R,
       // number of points in the vcluster containing the second most number of points
       const int splitPoints = C(vclusterOther, k);
 
-      if (states_[k].lifeTime >= parameters_.numSplitLifeTimeFrames && splitPoints >= parameters_.numSplitPoints)
+      if (states_[k].lifeTime >= parameters_.numSplitLifeTimeFrames
+          && splitPoints >= parameters_.numSplitPoints * em_sample_ratio_)
         states_[k].splitCounter++;
       else
         states_[k].splitCounter = 0;
@@ -9,6 +9,7 @@
 #include "GmmData.hpp"
 
 #include <chrono>
+#include <random>
 
 #include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/segmentation/extract_clusters.h>
@@ -35,6 +36,8 @@ public:
     }
 
     frameData->obstacleParams = extractObstacleParams(frameData->cloudMinusSurfaces);
+    if (parameters_.enableKalmanFilter)
+      kalmanFilter_.update(frameData->obstacleParams, frameData->timestamp);
     notifyObservers(frameData);
 //    ObstacleSegmenter::updateFrame(frameData);
   }
@@ -45,9 +48,17 @@ private:
 
   void initialize(PointCloudT const* pc);
 
+  // draw a subsample of (about) emSubsampleSize points, stratified over the vclusters of the current voxel grid.
+  // fills vcluster_point_table for all points of pc as a side effect
+  void subsample(PointCloudT const& pc, PointCloudT& out);
+
   void e_step(PointCloudT const* pc, Eigen::MatrixXf& R, Eigen::MatrixXi& C,
               Eigen::Matrix4Xf& VCMeans, std::vector<Eigen::Matrix4f>& VCSM,
-              Eigen::VectorXi& VCPointCounts);
+              Eigen::VectorXi& VCPointCounts, std::vector<int>& vclusterTable,
+              std::vector<int>& stateLabels);
+
+  // label each point of pc with the state it is hard assigned to by the current states (-1 if none)
+  void hardAssign(PointCloudT const* pc, std::vector<int>& stateLabels) const;
 
   void m_step(PointCloudT const* pc, Eigen::MatrixXf const& R, Eigen::MatrixXi const& C, Eigen::VectorXf const& rks,
               Eigen::VectorXi const& cks, std::vector<GMM::State>& newStates, std::vector<int>& removedStates);
@@ -72,7 +83,15 @@ private:
   KalmanObstacleTracker kalmanFilter_;
   // cached vclusters for points
   std::vector<int> vcluster_point_table;
+  // cached vclusters for the points of the EM subsample
+  std::vector<int> vcluster_sample_table;
+  // hard assigned state for points (-1 if none)
+  std::vector<int> point_state_label;
+  std::vector<int> sample_state_label;
   std::vector<int> state_main_vcluster;
+  // (number of points EM runs on) / (number of points in the cloud), used to scale point count thresholds
+  float em_sample_ratio_;
+  std::mt19937 rng_;
 
   bool initialized_;
 };
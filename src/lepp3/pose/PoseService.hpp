@@ -40,9 +40,10 @@ public:
   lepp::LolaKinematicsParams getParams() const;
 
   /**
-   * Force a dispatch of the next frame
+   * Force a dispatch of the next frame, captured at the given time (s, as
+   * given by the video source; 0 if unknown).
    */
-  virtual void triggerNextFrame() = 0;
+  virtual void triggerNextFrame(double timestamp) = 0;
 
 private:
   /**
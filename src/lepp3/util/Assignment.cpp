@@ -0,0 +1,76 @@
+#include "Assignment.h"
+
+#include <limits>
+
+std::vector<int> lepp::util::solveAssignment(const Eigen::MatrixXd& cost) {
+  // the algorithm needs at least as many columns as rows
+  if (cost.rows() > cost.cols()) {
+    const std::vector<int> colRow = solveAssignment(cost.transpose());
+    std::vector<int> rowCol(cost.rows(), -1);
+    for (size_t c = 0; c < colRow.size(); ++c) {
+      if (colRow[c] >= 0) {
+        rowCol[colRow[c]] = c;
+      }
+    }
+    return rowCol;
+  }
+
+  const int n = cost.rows();
+  const int m = cost.cols();
+  const double inf = std::numeric_limits<double>::infinity();
+
+  // potentials of the rows and columns, and the row matched to each column
+  // (1-based, column 0 is a virtual column used to add the next row)
+  std::vector<double> u(n + 1, 0.0), v(m + 1, 0.0);
+  std::vector<int> colRow(m + 1, 0), way(m + 1, 0);
+  for (int i = 1; i <= n; ++i) {
+    // find the shortest augmenting path from row i to a free column
+    colRow[0] = i;
+    int col = 0;
+    std::vector<double> minSlack(m + 1, inf);
+    std::vector<bool> used(m + 1, false);
+    do {
+      used[col] = true;
+      const int row = colRow[col];
+      double delta = inf;
+      int nextCol = 0;
+      for (int j = 1; j <= m; ++j) {
+        if (!used[j]) {
+          const double slack = cost(row - 1, j - 1) - u[row] - v[j];
+          if (slack < minSlack[j]) {
+            minSlack[j] = slack;
+            way[j] = col;
+          }
+          if (minSlack[j] < delta) {
+            delta = minSlack[j];
+            nextCol = j;
+          }
+        }
+      }
+      for (int j = 0; j <= m; ++j) {
+        if (used[j]) {
+          u[colRow[j]] += delta;
+          v[j] -= delta;
+        } else {
+          minSlack[j] -= delta;
+        }
+      }
+      col = nextCol;
+    } while (colRow[col] != 0);
+
+    // flip the matching along the path
+    do {
+      const int prevCol = way[col];
+      colRow[col] = colRow[prevCol];
+      col = prevCol;
+    } while (col != 0);
+  }
+
+  std::vector<int> rowCol(n, -1);
+  for (int j = 1; j <= m; ++j) {
+    if (colRow[j] != 0) {
+      rowCol[colRow[j] - 1] = j - 1;
+    }
+  }
+  return rowCol;
+}
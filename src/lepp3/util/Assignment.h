@@ -0,0 +1,23 @@
+#ifndef LEPP3_UTIL_ASSIGNMENT_H
+#define LEPP3_UTIL_ASSIGNMENT_H
+
+#include <vector>
+
+#include <Eigen/Dense>
+
+namespace lepp {
+namespace util {
+/**
+ * Solves the linear assignment problem for the given (possibly rectangular)
+ * cost matrix with the Hungarian algorithm: every row is assigned a distinct
+ * column (or every column a distinct row, if there are more rows than columns)
+ * such that the total cost is minimal.
+ *
+ * Returns the column assigned to each row, or -1 for rows that were left
+ * unassigned.
+ */
+std::vector<int> solveAssignment(const Eigen::MatrixXd& cost);
+}
+}
+
+#endif
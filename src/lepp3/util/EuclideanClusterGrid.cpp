@@ -0,0 +1,274 @@
+#include "EuclideanClusterGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+// bits per cell coordinate in a cell key
+const int KEY_BITS = 21;
+const int64_t KEY_MASK = (int64_t(1) << KEY_BITS) - 1;
+const uint32_t INVALID_CELL = std::numeric_limits<uint32_t>::max();
+// width of the xy tiles that are connected in parallel, in cells
+const int64_t TILE_CELLS = 64;
+
+int64_t cellKey(int64_t x, int64_t y, int64_t z) {
+  return ((x & KEY_MASK) << (2 * KEY_BITS)) | ((y & KEY_MASK) << KEY_BITS) | (z & KEY_MASK);
+}
+
+int64_t tileKey(int64_t cellKey) {
+  const int64_t x = (cellKey >> (2 * KEY_BITS)) & KEY_MASK;
+  const int64_t y = (cellKey >> KEY_BITS) & KEY_MASK;
+  return ((x / TILE_CELLS) << KEY_BITS) | (y / TILE_CELLS);
+}
+}
+
+lepp::util::EuclideanClusterGrid::EuclideanClusterGrid(float tolerance, float rangeFactor,
+                                                       size_t minClusterSize, size_t maxClusterSize)
+    : _tolerance(tolerance), _rangeFactor(rangeFactor),
+      _minClusterSize(minClusterSize), _maxClusterSize(maxClusterSize) {}
+
+void lepp::util::EuclideanClusterGrid::extract(const PointCloudT& pc, std::vector<pcl::PointIndices>& clusters) {
+  clusters.clear();
+
+  const size_t N = pc.size();
+  // the range is measured from the sensor, which is not at the origin once the
+  // cloud was transformed into the world frame
+  const Eigen::Vector3f sensor = pc.sensor_origin_.head<3>();
+  const float maxPointTolerance = MAX_TOLERANCE_RATIO * _tolerance;
+  Eigen::Vector3f minBounds = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+  float minTolerance = std::numeric_limits<float>::max();
+  float maxTolerance = 0.0f;
+  _pointTolerance.resize(N);
+  for (size_t i = 0; i < N; ++i) {
+    const PointT& pt = pc[i];
+    if (std::isfinite(pt.x) && std::isfinite(pt.y) && std::isfinite(pt.z)) {
+      minBounds = minBounds.cwiseMin(pt.getVector3fMap());
+      _pointTolerance[i] = std::min(maxPointTolerance,
+                                    _tolerance + _rangeFactor * (pt.getVector3fMap() - sensor).squaredNorm());
+      minTolerance = std::min(minTolerance, _pointTolerance[i]);
+      maxTolerance = std::max(maxTolerance, _pointTolerance[i]);
+    }
+  }
+  if (maxTolerance <= 0.0f) {
+    return;
+  }
+
+  // cells with a diagonal of the smallest tolerance are always fully connected
+  const float cellSize = minTolerance / std::sqrt(3.0f);
+  updateNeighborOffsets(maxTolerance / cellSize);
+
+  // hash the points into cells
+  _cellIndex.clear();
+  _cellIndex.reserve(N);
+  _cellKeys.clear();
+  _cellTolerance.clear();
+  _pointCell.resize(N);
+  size_t numValid = 0;
+  for (size_t i = 0; i < N; ++i) {
+    const PointT& pt = pc[i];
+    if (!std::isfinite(pt.x) || !std::isfinite(pt.y) || !std::isfinite(pt.z)) {
+      _pointCell[i] = INVALID_CELL;
+      continue;
+    }
+
+    // shift by the neighbor reach so that neighbor cell coordinates are never negative
+    const Eigen::Vector3f cell = (pt.getVector3fMap() - minBounds) / cellSize;
+    const int64_t key = cellKey(static_cast<int64_t>(cell.x()) + _neighborReach,
+                                static_cast<int64_t>(cell.y()) + _neighborReach,
+                                static_cast<int64_t>(cell.z()) + _neighborReach);
+
+    auto inserted = _cellIndex.emplace(key, static_cast<uint32_t>(_cellKeys.size()));
+    if (inserted.second) {
+      _cellKeys.push_back(key);
+      _cellTolerance.push_back(0.0f);
+    }
+    _pointCell[i] = inserted.first->second;
+    _cellTolerance[_pointCell[i]] = std::max(_cellTolerance[_pointCell[i]], _pointTolerance[i]);
+    ++numValid;
+  }
+
+  const size_t numCells = _cellKeys.size();
+  if (numCells == 0) {
+    return;
+  }
+
+  // sort the points by cell (counting sort)
+  _cellStart.assign(numCells + 1, 0);
+  for (size_t i = 0; i < N; ++i) {
+    if (_pointCell[i] != INVALID_CELL) {
+      ++_cellStart[_pointCell[i] + 1];
+    }
+  }
+  std::partial_sum(_cellStart.begin(), _cellStart.end(), _cellStart.begin());
+
+  _cellPoints.resize(numValid);
+  {
+    std::vector<uint32_t> next(_cellStart.begin(), _cellStart.end() - 1);
+    for (size_t i = 0; i < N; ++i) {
+      if (_pointCell[i] != INVALID_CELL) {
+        _cellPoints[next[_pointCell[i]]++] = i;
+      }
+    }
+  }
+
+  // connect the cells within each tile in parallel. The union-find trees never leave a tile
+  // in this phase, so the tiles can modify _parent independently
+  _parent.resize(numCells);
+  std::iota(_parent.begin(), _parent.end(), 0);
+  const int numTiles = buildTiles();
+#pragma omp parallel for schedule(dynamic)
+  for (int t = 0; t < numTiles; ++t) {
+    _borderPairs[t].clear();
+    for (uint32_t i = _tileStart[t]; i < _tileStart[t + 1]; ++i) {
+      const uint32_t a = _tileCells[i];
+      for (const NeighborOffset& offset : _neighborOffsets) {
+        // no point pair can be within the tolerance of the points of a anymore
+        if (offset.gap * cellSize >= _cellTolerance[a]) {
+          break;
+        }
+
+        const auto neighbor = _cellIndex.find(_cellKeys[a] + offset.key);
+        if (neighbor == _cellIndex.end()) {
+          continue;
+        }
+
+        const uint32_t b = neighbor->second;
+        if (_cellTile[b] != static_cast<uint32_t>(t)) {
+          _borderPairs[t].emplace_back(a, b);
+          continue;
+        }
+
+        const uint32_t rootA = findRoot(a);
+        const uint32_t rootB = findRoot(b);
+        if (rootA != rootB && cellsTouch(pc, a, b)) {
+          _parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+        }
+      }
+    }
+  }
+
+  // merge the clusters that touch across tile borders
+  for (int t = 0; t < numTiles; ++t) {
+    for (const auto& pair : _borderPairs[t]) {
+      const uint32_t rootA = findRoot(pair.first);
+      const uint32_t rootB = findRoot(pair.second);
+      if (rootA != rootB && cellsTouch(pc, pair.first, pair.second)) {
+        _parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+      }
+    }
+  }
+
+  // count the points per cluster and create the clusters within the size limits
+  std::vector<uint32_t> rootPoints(numCells, 0);
+  for (uint32_t c = 0; c < numCells; ++c) {
+    rootPoints[findRoot(c)] += _cellStart[c + 1] - _cellStart[c];
+  }
+
+  std::vector<int> rootCluster(numCells, -1);
+  for (uint32_t c = 0; c < numCells; ++c) {
+    if (_parent[c] == c && rootPoints[c] >= _minClusterSize && rootPoints[c] <= _maxClusterSize) {
+      rootCluster[c] = clusters.size();
+      clusters.emplace_back();
+      clusters.back().indices.reserve(rootPoints[c]);
+    }
+  }
+
+  // iterate the points in order to get ascending indices per cluster
+  for (size_t i = 0; i < N; ++i) {
+    if (_pointCell[i] == INVALID_CELL) {
+      continue;
+    }
+    const int cluster = rootCluster[findRoot(_pointCell[i])];
+    if (cluster >= 0) {
+      clusters[cluster].indices.push_back(i);
+    }
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const pcl::PointIndices& a, const pcl::PointIndices& b) {
+                     return a.indices.size() > b.indices.size();
+                   });
+}
+
+void lepp::util::EuclideanClusterGrid::updateNeighborOffsets(float distance) {
+  const int reach = static_cast<int>(distance) + 1;
+  if (reach == _neighborReach) {
+    return;
+  }
+
+  // number of whole cells between two cells along an axis
+  auto gap = [](int d) { return std::max(std::abs(d) - 1, 0); };
+
+  _neighborReach = reach;
+  _neighborOffsets.clear();
+  for (int dx = -reach; dx <= reach; ++dx) {
+    for (int dy = -reach; dy <= reach; ++dy) {
+      for (int dz = -reach; dz <= reach; ++dz) {
+        // only "forward" neighbors, the backward ones are checked from the other cell
+        const bool forward = dx > 0 || (dx == 0 && (dy > 0 || (dy == 0 && dz > 0)));
+        const float cellGap = std::sqrt(static_cast<float>(gap(dx) * gap(dx) + gap(dy) * gap(dy) + gap(dz) * gap(dz)));
+        if (forward && cellGap < reach) {
+          _neighborOffsets.push_back({(int64_t(dx) << (2 * KEY_BITS)) + (int64_t(dy) << KEY_BITS) + dz, cellGap});
+        }
+      }
+    }
+  }
+
+  std::stable_sort(_neighborOffsets.begin(), _neighborOffsets.end(),
+                   [](const NeighborOffset& a, const NeighborOffset& b) { return a.gap < b.gap; });
+}
+
+size_t lepp::util::EuclideanClusterGrid::buildTiles() {
+  const size_t numCells = _cellKeys.size();
+
+  std::unordered_map<int64_t, uint32_t> tileIndex;
+  _cellTile.resize(numCells);
+  for (size_t c = 0; c < numCells; ++c) {
+    auto inserted = tileIndex.emplace(tileKey(_cellKeys[c]), static_cast<uint32_t>(tileIndex.size()));
+    _cellTile[c] = inserted.first->second;
+  }
+  const size_t numTiles = tileIndex.size();
+
+  // sort the cells by tile (counting sort)
+  _tileStart.assign(numTiles + 1, 0);
+  for (size_t c = 0; c < numCells; ++c) {
+    ++_tileStart[_cellTile[c] + 1];
+  }
+  std::partial_sum(_tileStart.begin(), _tileStart.end(), _tileStart.begin());
+
+  _tileCells.resize(numCells);
+  std::vector<uint32_t> next(_tileStart.begin(), _tileStart.end() - 1);
+  for (size_t c = 0; c < numCells; ++c) {
+    _tileCells[next[_cellTile[c]]++] = c;
+  }
+
+  if (_borderPairs.size() < numTiles) {
+    _borderPairs.resize(numTiles);
+  }
+  return numTiles;
+}
+
+uint32_t lepp::util::EuclideanClusterGrid::findRoot(uint32_t cell) {
+  // path halving
+  while (_parent[cell] != cell) {
+    _parent[cell] = _parent[_parent[cell]];
+    cell = _parent[cell];
+  }
+  return cell;
+}
+
+bool lepp::util::EuclideanClusterGrid::cellsTouch(const PointCloudT& pc, uint32_t a, uint32_t b) const {
+  for (uint32_t i = _cellStart[a]; i < _cellStart[a + 1]; ++i) {
+    const Eigen::Vector3f p = pc[_cellPoints[i]].getVector3fMap();
+    const float toleranceP = _pointTolerance[_cellPoints[i]];
+    for (uint32_t j = _cellStart[b]; j < _cellStart[b + 1]; ++j) {
+      const float tolerance = std::min(toleranceP, _pointTolerance[_cellPoints[j]]);
+      if ((pc[_cellPoints[j]].getVector3fMap() - p).squaredNorm() <= tolerance * tolerance) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,101 @@
+#ifndef LEPP3_UTIL_EUCLIDEANCLUSTERGRID_H
+#define LEPP3_UTIL_EUCLIDEANCLUSTERGRID_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <pcl/PointIndices.h>
+#include "lepp3/Typedefs.hpp"
+
+namespace lepp {
+namespace util {
+/**
+ * Euclidean clustering on a sparse voxel grid, without building a kd-tree.
+ *
+ * Produces the same clusters as pcl::EuclideanClusterExtraction for the given
+ * tolerance: two points are in the same cluster iff they are connected by a
+ * chain of points that are at most `tolerance` apart. Clusters are returned
+ * sorted by descending size with ascending point indices.
+ *
+ * Optionally, the tolerance of each point grows with its squared range (the
+ * distance to the sensor origin of the cloud), i.e. tolerance + rangeFactor *
+ * range^2, up to MAX_TOLERANCE_RATIO times the tolerance. Two points are then
+ * connected if they are within the smaller tolerance of the two.
+ *
+ * Points are hashed into cells whose diagonal equals the smallest tolerance,
+ * so all the points of a cell belong to the same cluster. Cells are then
+ * connected with a union-find, checking point pairs only between neighboring
+ * cells that are not known to be connected yet.
+ *
+ * The cells are partitioned into xy tiles which are connected in parallel;
+ * clusters touching across tile borders are merged afterwards.
+ */
+class EuclideanClusterGrid {
+public:
+  // the largest point tolerance relative to the base tolerance, which bounds the
+  // number of neighboring cells that have to be checked
+  static constexpr float MAX_TOLERANCE_RATIO = 4.0f;
+
+  EuclideanClusterGrid(float tolerance, float rangeFactor, size_t minClusterSize, size_t maxClusterSize);
+
+  // cluster the (finite) points of the cloud, dropping clusters outside of the size limits
+  void extract(const PointCloudT& pc, std::vector<pcl::PointIndices>& clusters);
+
+private:
+  struct NeighborOffset {
+    int64_t key;
+    // distance between the closest points of the cells, in cells
+    float gap;
+  };
+
+  // make sure the neighbor offsets reach the given distance (in cells)
+  void updateNeighborOffsets(float distance);
+
+  uint32_t findRoot(uint32_t cell);
+
+  // sort the cells into xy tiles, returns the number of tiles
+  size_t buildTiles();
+
+  // true if any pair of points from the two cells is within the tolerance
+  bool cellsTouch(const PointCloudT& pc, uint32_t a, uint32_t b) const;
+
+public:
+  const float _tolerance;
+  const float _rangeFactor;
+  const size_t _minClusterSize;
+  const size_t _maxClusterSize;
+
+private:
+  // offsets of the neighboring cells up to _neighborReach cells away that can contain points
+  // within the tolerance, sorted by gap. only one of each symmetric pair
+  std::vector<NeighborOffset> _neighborOffsets;
+  int _neighborReach = 0;
+
+  // tolerance for each point
+  std::vector<float> _pointTolerance;
+
+  // maps the key of an occupied cell to its index
+  std::unordered_map<int64_t, uint32_t> _cellIndex;
+  std::vector<int64_t> _cellKeys;
+  // largest point tolerance within each cell
+  std::vector<float> _cellTolerance;
+  // cell index for each point
+  std::vector<uint32_t> _pointCell;
+  // points sorted by cell, the points of cell c are _cellPoints[_cellStart[c].._cellStart[c + 1])
+  std::vector<uint32_t> _cellStart;
+  std::vector<uint32_t> _cellPoints;
+  // union-find forest over the cells
+  std::vector<uint32_t> _parent;
+  // tile index for each cell
+  std::vector<uint32_t> _cellTile;
+  // cells sorted by tile, the cells of tile t are _tileCells[_tileStart[t].._tileStart[t + 1])
+  std::vector<uint32_t> _tileStart;
+  std::vector<uint32_t> _tileCells;
+  // neighboring cell pairs (a, b) with b in another tile than a, collected per tile
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> _borderPairs;
+};
+}
+}
+
+#endif
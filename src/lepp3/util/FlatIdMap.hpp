@@ -0,0 +1,164 @@
+#ifndef LEPP3_UTIL_FLATIDMAP_H
+#define LEPP3_UTIL_FLATIDMAP_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "lepp3/Typedefs.hpp"
+
+namespace lepp {
+namespace util {
+/**
+ * A map from model ids to values, stored without per-entry allocations.
+ *
+ * The entries (id, value and the generation in which the id was last seen)
+ * are kept in contiguous arrays in no particular order, so they can be
+ * scanned linearly. An open addressing hash table (linear probing) maps ids
+ * to entry indices. Removing an entry moves the last entry into its place.
+ *
+ * The generation stamps allow finding the entries that were not seen in the
+ * current generation with a single pass, instead of building and diffing sets
+ * of ids.
+ */
+template<class Value>
+class FlatIdMap {
+public:
+  FlatIdMap() : _mask(0), _shift(32) {}
+
+  // number of entries
+  size_t size() const { return _ids.size(); }
+
+  // index of the entry with the given id, or -1 if there is none
+  int find(model_id_t id) const;
+  // index of the entry with the given id, adding a default constructed entry if there is none
+  size_t insert(model_id_t id, bool& inserted);
+  // remove the entry at the given index, the last entry takes its place
+  void remove(size_t i);
+
+  model_id_t id(size_t i) const { return _ids[i]; }
+  Value& value(size_t i) { return _values[i]; }
+  const Value& value(size_t i) const { return _values[i]; }
+  // the generation that the entry was last seen in
+  uint32_t& lastSeen(size_t i) { return _lastSeen[i]; }
+
+private:
+  static const int32_t EMPTY = -1;
+
+  size_t home(model_id_t id) const {
+    return (static_cast<uint32_t>(id) * 2654435761u) >> _shift;
+  }
+  // table slot that refers to the entry with the given index
+  size_t slotOf(size_t i) const;
+  // grow the table so that it is at most half full with `entries` entries
+  void reserve(size_t entries);
+
+  // per entry
+  std::vector<model_id_t> _ids;
+  std::vector<Value> _values;
+  std::vector<uint32_t> _lastSeen;
+
+  // entry index per slot, or EMPTY
+  std::vector<int32_t> _table;
+  size_t _mask;
+  int _shift;
+};
+
+template<class Value>
+int FlatIdMap<Value>::find(model_id_t id) const {
+  if (_table.empty()) {
+    return -1;
+  }
+  for (size_t s = home(id); ; s = (s + 1) & _mask) {
+    const int32_t i = _table[s];
+    if (i == EMPTY) {
+      return -1;
+    }
+    if (_ids[i] == id) {
+      return i;
+    }
+  }
+}
+
+template<class Value>
+size_t FlatIdMap<Value>::insert(model_id_t id, bool& inserted) {
+  reserve(_ids.size() + 1);
+  size_t s = home(id);
+  for (; _table[s] != EMPTY; s = (s + 1) & _mask) {
+    if (_ids[_table[s]] == id) {
+      inserted = false;
+      return _table[s];
+    }
+  }
+
+  inserted = true;
+  _table[s] = _ids.size();
+  _ids.push_back(id);
+  _values.emplace_back();
+  _lastSeen.push_back(0);
+  return _ids.size() - 1;
+}
+
+template<class Value>
+void FlatIdMap<Value>::remove(size_t i) {
+  // backward shift deletion: move the following entries of the probe
+  // sequence into the hole, unless that would put them before their home slot
+  size_t hole = slotOf(i);
+  for (size_t s = (hole + 1) & _mask; _table[s] != EMPTY; s = (s + 1) & _mask) {
+    const size_t h = home(_ids[_table[s]]);
+    const bool canMove = hole <= s ? (h <= hole || h > s) : (h <= hole && h > s);
+    if (canMove) {
+      _table[hole] = _table[s];
+      hole = s;
+    }
+  }
+  _table[hole] = EMPTY;
+
+  const size_t last = _ids.size() - 1;
+  if (i != last) {
+    _table[slotOf(last)] = i;
+    _ids[i] = _ids[last];
+    _values[i] = std::move(_values[last]);
+    _lastSeen[i] = _lastSeen[last];
+  }
+  _ids.pop_back();
+  _values.pop_back();
+  _lastSeen.pop_back();
+}
+
+template<class Value>
+size_t FlatIdMap<Value>::slotOf(size_t i) const {
+  size_t s = home(_ids[i]);
+  while (_table[s] != static_cast<int32_t>(i)) {
+    s = (s + 1) & _mask;
+  }
+  return s;
+}
+
+template<class Value>
+void FlatIdMap<Value>::reserve(size_t entries) {
+  if (2 * entries <= _table.size()) {
+    return;
+  }
+
+  size_t slots = 16;
+  int shift = 28;
+  while (slots < 2 * entries) {
+    slots *= 2;
+    --shift;
+  }
+  _table.assign(slots, static_cast<int32_t>(EMPTY));
+  _mask = slots - 1;
+  _shift = shift;
+  for (size_t i = 0; i < _ids.size(); ++i) {
+    size_t s = home(_ids[i]);
+    while (_table[s] != EMPTY) {
+      s = (s + 1) & _mask;
+    }
+    _table[s] = i;
+  }
+}
+}
+}
+
+#endif
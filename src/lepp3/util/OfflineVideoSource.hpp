@@ -90,6 +90,8 @@ void OfflineVideoSource<PointT>::cloud_cb_(
   // Cloud
   FrameDataPtr frameData(new FrameData(++frameCount));
   frameData->cloud = cloud;
+  // PCL stamps are in microseconds
+  frameData->timestamp = cloud->header.stamp * 1e-6;
   this->setNextFrame(frameData);
 
   // RGB image
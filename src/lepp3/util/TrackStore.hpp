@@ -0,0 +1,117 @@
+#ifndef LEPP3_UTIL_TRACKSTORE_H
+#define LEPP3_UTIL_TRACKSTORE_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "lepp3/Typedefs.hpp"
+#include "lepp3/util/FlatIdMap.hpp"
+
+namespace lepp {
+namespace util {
+/**
+ * Storage for the tracks of a tracker (obstacles or surfaces).
+ *
+ * The tracks are kept in parallel contiguous arrays (the tracked model, the
+ * found and lost counters and the materialization flag), so that the
+ * per-frame updates of the trackers are linear scans. Removing a track moves
+ * the last track into its place.
+ *
+ * Tracks are identified by ids that stay valid while the track moves within
+ * the arrays. The ids are handed out in increasing order (as 31 bit positive
+ * ints) and map to the current index of their track through a `FlatIdMap`,
+ * which also holds the models. An id is only reused after all others were,
+ * and never while its track is still alive, so the id of a removed track does
+ * not stand for another obstacle for a long time.
+ */
+template<class ModelPtr>
+class TrackStore {
+public:
+  TrackStore() : _nextId(0) {}
+
+  // number of tracks
+  size_t size() const { return _tracks.size(); }
+
+  // add a new track for the model, returns its id
+  model_id_t add(const ModelPtr& model);
+  // remove the track at the given index, the last track takes its place
+  void remove(size_t i);
+  // index of the track with the given id, or -1 if there is no such track (anymore)
+  int index(model_id_t id) const { return _tracks.find(id); }
+
+  model_id_t id(size_t i) const { return _tracks.id(i); }
+  ModelPtr& model(size_t i) { return _tracks.value(i); }
+  const ModelPtr& model(size_t i) const { return _tracks.value(i); }
+  // number of subsequent frames that the model was found in, before it got materialized
+  int& framesFound(size_t i) { return _framesFound[i]; }
+  // number of subsequent frames that the model was no longer found in
+  int& framesLost(size_t i) { return _framesLost[i]; }
+  bool materialized(size_t i) const { return _materialized[i] != 0; }
+  void setMaterialized(size_t i) { _materialized[i] = 1; }
+
+  // the models of all materialized tracks
+  std::vector<ModelPtr> materializedModels() const;
+
+private:
+  // ids are positive ints
+  static const uint32_t ID_MASK = 0x7fffffff;
+
+  // per track, the ids and models are in the map
+  FlatIdMap<ModelPtr> _tracks;
+  std::vector<int> _framesFound;
+  std::vector<int> _framesLost;
+  std::vector<uint8_t> _materialized;
+
+  uint32_t _nextId;
+};
+
+template<class ModelPtr>
+model_id_t TrackStore<ModelPtr>::add(const ModelPtr& model) {
+  if (_tracks.size() > ID_MASK) {
+    throw std::length_error("TrackStore: too many tracks");
+  }
+  // after wrapping around, skip the ids of tracks that are still alive
+  model_id_t id;
+  do {
+    id = static_cast<model_id_t>(_nextId++ & ID_MASK);
+  } while (_tracks.find(id) >= 0);
+
+  bool inserted;
+  const size_t i = _tracks.insert(id, inserted);
+  _tracks.value(i) = model;
+  _framesFound.push_back(0);
+  _framesLost.push_back(0);
+  _materialized.push_back(0);
+  return id;
+}
+
+template<class ModelPtr>
+void TrackStore<ModelPtr>::remove(size_t i) {
+  _tracks.remove(i);
+
+  const size_t last = _framesFound.size() - 1;
+  if (i != last) {
+    _framesFound[i] = _framesFound[last];
+    _framesLost[i] = _framesLost[last];
+    _materialized[i] = _materialized[last];
+  }
+  _framesFound.pop_back();
+  _framesLost.pop_back();
+  _materialized.pop_back();
+}
+
+template<class ModelPtr>
+std::vector<ModelPtr> TrackStore<ModelPtr>::materializedModels() const {
+  std::vector<ModelPtr> models;
+  for (size_t i = 0; i < _tracks.size(); ++i) {
+    if (_materialized[i]) {
+      models.push_back(_tracks.value(i));
+    }
+  }
+  return models;
+}
+}
+}
+
+#endif
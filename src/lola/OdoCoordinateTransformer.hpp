@@ -86,6 +86,11 @@ public:
    */
   bool apply(PointT& original);
 
+  /**
+   * `PointFilter` interface method.
+   */
+  void transformOrigin(Eigen::Vector4f& origin) override;
+
 protected:
   /**
    * Gets the kinematics parameters that should be used for constructing the
@@ -229,6 +234,18 @@ bool OdoCoordinateTransformer<PointT>::apply(PointT& original) {
   return true;
 }
 
+template<class PointT>
+void OdoCoordinateTransformer<PointT>::transformOrigin(Eigen::Vector4f& origin) {
+  // The camera origin is transformed like any other point.
+  PointT pt;
+  pt.x = origin[0];
+  pt.y = origin[1];
+  pt.z = origin[2];
+  if (apply(pt)) {
+    origin.head<3>() = pt.getVector3fMap();
+  }
+}
+
 /**
  * A concrete implementation of the transformer, which obtains its kinematics
  * information from the robot. Relies on a `PoseService` instance that it can
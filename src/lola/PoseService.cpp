@@ -2,11 +2,11 @@
 #include "lola/pose/PoseFileService.hpp"
 #include "lola/pose/PoseUdpService.hpp"
 
-std::shared_ptr<lepp::PoseService> PoseServiceFromUdp(std::string const& host, int port) {
+std::shared_ptr<lepp::PoseService> PoseServiceFromUdp(std::string const& host, int port, int latency) {
   uint16_t p = static_cast<uint16_t>(port);
   assert(p == port);
 
-  std::shared_ptr<lepp::PoseService> ps(new PoseUdpService(host, p));
+  std::shared_ptr<lepp::PoseService> ps(new PoseUdpService(host, p, latency));
   return ps;
 }
 
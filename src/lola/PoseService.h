@@ -5,9 +5,10 @@
 #include "lepp3/pose/PoseService.hpp"
 
 /**
- * Creates a Pose service which listens on a UDP port
+ * Creates a Pose service which listens on a UDP port. Poses are looked up
+ * `latency` ms before the frames' capture time, see `PoseUdpService`.
  */
-std::shared_ptr<lepp::PoseService> PoseServiceFromUdp(std::string const& host, int port);
+std::shared_ptr<lepp::PoseService> PoseServiceFromUdp(std::string const& host, int port, int latency = 0);
 /**
  * Creates a Pose service from a saved file
  */
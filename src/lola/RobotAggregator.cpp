@@ -1,5 +1,6 @@
 #include "lola/RobotAggregator.h"
 #include "deps/easylogging++.h"
+#include <iface_vision_cloud.hpp>
 
 using namespace lepp;
 
@@ -52,11 +53,14 @@ RobotAggregator::RobotAggregator(boost::shared_ptr<RobotService> service,
                                 std::vector<std::string> datatypes,
                                 Robot& robot,
                                 double min_surface_height,
-                                double surface_normal_tolerance
+                                double surface_normal_tolerance,
+                                PointCloudEncoding const& pointcloud_encoding,
+                                ObstacleChangeTolerance const& obstacle_tolerance
                               )
-    : service_(service), diff_(freq), next_id_(0),
+    : service_(service), diff_(freq, obstacle_tolerance), next_id_(0),
       min_surface_height(min_surface_height),
       surface_normal_tolerance(surface_normal_tolerance),
+      pointcloud_encoding_(pointcloud_encoding),
       robot_(robot) {
 
   for (auto t : datatypes)
@@ -86,19 +90,6 @@ RobotAggregator::RobotAggregator(boost::shared_ptr<RobotService> service,
     diff_.set_new_surface_callback(boost::bind(&RobotAggregator::new_surface_cb_, this, _1, _2));
     diff_.set_modified_surface_callback(boost::bind(&RobotAggregator::mod_surface_cb_, this, _1, _2));
     diff_.set_deleted_surface_callback(boost::bind(&RobotAggregator::del_surface_cb_, this, _1, _2));
-
-    // prepare dummy convex hull for surfaces we don't want the planning system to consider
-    dummy_hull.reset(new PointCloudT());
-    dummy_hull->width = 8;
-    dummy_hull->height = 1;
-    dummy_hull->is_dense = false;
-    dummy_hull->points.resize(dummy_hull->width * dummy_hull->height);
-    for (size_t i = 0; i < dummy_hull->width * dummy_hull->height; i++)
-    {
-      (*dummy_hull)[i].x = -4.9 + (sin((float)i) * 0.01f);
-      (*dummy_hull)[i].y = -4.9 + (cos((float)i) * 0.01f);
-      (*dummy_hull)[i].z = -4.9 + ((float)i * 0.01f);
-    }
   }
 }
 
@@ -142,16 +133,7 @@ void RobotAggregator::new_surface_cb_(SurfaceModel& model, long frame_num) {
     std::cout << "  " << p.x << ", " << p.y << ", " << p.z << std::endl;
   }
   std::cout << "]" << std::endl;
-  if (shouldSendSurface(model))
-  {
-    sendNew(model, frame_num);
-  }
-  else
-  {
-    SurfaceModel hack = model;
-    hack.set_hull(dummy_hull);
-    sendNew(hack, frame_num);
-  }
+  sendNew(model, frame_num);
 }
 
 bool RobotAggregator::del_obstacle_cb_(ObjectModel& model, long frame_num) {
@@ -252,16 +234,7 @@ std::cout << "]" << std::endl;
    return;
  }
 
-  if (shouldSendSurface(model))
-  {
-    sendModify(model, frame_num);
-  }
-  else
-  {
-    SurfaceModel hack = model;
-    hack.set_hull(dummy_hull);
-    sendModify(hack, frame_num);
-  }
+  sendModify(model, frame_num);
 }
 
 std::vector<ObjectModel*> RobotAggregator::getPrimitives(ObjectModel& model) const {
@@ -274,106 +247,109 @@ void RobotAggregator::sendNew(ObjectModel& new_model, int model_id, int part_id,
   CoefsVisitor coefs;
   new_model.accept(coefs);
 
-  VisionMessage msg = VisionMessage(ObstacleMessage::SetMessage(
-      coefs.type_id(), model_id, part_id, coefs.radius(), coefs.coefs()),
-      frame_num);
   LINFO << "RobotAggregator: Creating new primitive ["
         << "type = " << coefs.type_id()
         << "; id = " << part_id
         << "]";
-  service_->sendMessage(msg);
+  batch_->addObstacle(ObstacleMessage::SetMessage(
+      coefs.type_id(), model_id, part_id, coefs.radius(), coefs.coefs()));
 }
 
 void RobotAggregator::sendNew(SurfaceModel& new_surface, long frame_num) {
-  std::vector<float> vertices;
-  std::vector<float> normal = {new_surface.get_planeCoefficients().values[0],new_surface.get_planeCoefficients().values[1],new_surface.get_planeCoefficients().values[2]};
-  for(auto point : new_surface.get_hull()->points)
-  {
-    vertices.push_back(point.x);
-    vertices.push_back(point.y);
-    vertices.push_back(point.z);
-  }
-
-  VisionMessage msg = VisionMessage(SurfaceMessage::SetMessage(new_surface.id(), normal, vertices), frame_num);
-
   // LINFO << "RobotAggregator: Creating new surface ["
   //       << "id = " << new_surface.id()
   //       << "]";
-  service_->sendMessage(msg);
+  addSurface(new_surface, am2b_iface::SET_SURFACE);
 }
 
 void RobotAggregator::sendDeleteObstacle(int id, long frame_num) {
   // LINFO << "RobotAggregator: Deleting a primitive id = "
   //       << id;
-  VisionMessage del = VisionMessage(ObstacleMessage::DeleteMessage(id), frame_num);
-  service_->sendMessage(del);
+  batch_->addObstacle(ObstacleMessage::DeleteMessage(id));
 }
 
 void RobotAggregator::sendDeleteObstaclePart(int model_id, int part_id, long frame_num) {
   // LINFO << "RobotAggregator: Deleting a primitive id = "
   //       << part_id;
-  VisionMessage del = VisionMessage(ObstacleMessage::DeletePartMessage(model_id, part_id), frame_num);
-  service_->sendMessage(del);
+  batch_->addObstacle(ObstacleMessage::DeletePartMessage(model_id, part_id));
 }
 
 void RobotAggregator::sendDeleteSurface(int id, long frame_num)
 {
   // LINFO << "RobotAggregator: Deleting surface: " << id;
-  VisionMessage msg = VisionMessage(SurfaceMessage::DeleteMessage(id), frame_num);
-  service_->sendMessage(msg);
+  batch_->addSurfaceRemoval(id);
 }
 
 void RobotAggregator::sendModify(ObjectModel& model, int model_id, int part_id, long frame_num) {
   CoefsVisitor coefs;
   model.accept(coefs);
-  VisionMessage msg = VisionMessage(ObstacleMessage::ModifyMessage(
-      coefs.type_id(), model_id, part_id, coefs.radius(), coefs.coefs()),
-      frame_num);
   LINFO << "RobotAggregator: Modifying existing primitive ["
             << "type = " << coefs.type_id()
             << "; id = " << model_id << " | " << part_id
             << "]";
-  service_->sendMessage(msg);
+  batch_->addObstacle(ObstacleMessage::ModifyMessage(
+      coefs.type_id(), model_id, part_id, coefs.radius(), coefs.coefs()));
 }
 
 void RobotAggregator::sendModify(SurfaceModel& surface, long frame_num)
 {
-  std::vector<float> vertices;
-  std::vector<float> normal = {surface.get_planeCoefficients().values[0],surface.get_planeCoefficients().values[1],surface.get_planeCoefficients().values[2]};
-  for(auto point : surface.get_hull()->points)
-  {
-    vertices.push_back(point.x);
-    vertices.push_back(point.y);
-    vertices.push_back(point.z);
-  }
-
-  VisionMessage msg = VisionMessage(SurfaceMessage::ModifyMessage(surface.id(), normal, vertices), frame_num);
-
   // LINFO << "RobotAggregator: Modifying existing surface ["
   //       << "id = " << surface.id()
   //      << "]";
-  service_->sendMessage(msg);
+  addSurface(surface, am2b_iface::MODIFY_SURFACE);
+}
+
+void RobotAggregator::addSurface(SurfaceModel& surface, uint32_t action)
+{
+  float const normal[3] = { surface.get_planeCoefficients().values[0],
+                            surface.get_planeCoefficients().values[1],
+                            surface.get_planeCoefficients().values[2] };
+  std::vector<float> vertices;
+  if (shouldSendSurface(surface))
+  {
+    for (auto const& point : surface.get_hull()->points)
+    {
+      vertices.push_back(point.x);
+      vertices.push_back(point.y);
+      vertices.push_back(point.z);
+    }
+  }
+  batch_->addSurface(action, surface.id(), normal, vertices.data(), vertices.size() / 3);
 }
 
 void RobotAggregator::sendPointCloud(PointCloudConstPtr cloud, long frame_num)
 {
-  unsigned char* pt_data = (unsigned char*)&cloud->points[0];
-  VisionMessage msg = VisionMessage(PointCloudMessage(pt_data, cloud->points.size(), sizeof(PointT)), frame_num);
+  if (pointcloud_encoding_.compress)
+  {
+    std::shared_ptr<std::vector<uint8_t>> data = std::make_shared<std::vector<uint8_t>>();
+    CompressedPointCloudMessage const compressed = am2b_iface::cloud_codec::encode(
+        cloud->points.data(), cloud->points.size(), sizeof(PointT),
+        pointcloud_encoding_.resolution, pointcloud_encoding_.voxel_size, *data);
+    std::shared_ptr<const void> payload(data, data->data());
+    service_->sendMessage(VisionMessage(compressed, frame_num, payload, data->size()));
+    return;
+  }
+
+  // The message references the points of the cloud, keeping the cloud alive
+  // until it is sent, instead of copying them.
+  std::shared_ptr<const void> points(cloud->points.data(), [cloud](const void*) {});
+  VisionMessage msg = VisionMessage(PointCloudMessage(cloud->points.size(), sizeof(PointT)), frame_num, points);
 
   service_->sendMessage(msg);
 }
 
 void RobotAggregator::sendRGBImage(cv::Mat const& image, long frame_num)
 {
-  const unsigned char* img_data = nullptr;
-  if (CV_8UC3 == image.type()) {
-    img_data = image.data;
-  } else {
+  if (CV_8UC3 != image.type()) {
     std::ostringstream ss;
     ss << "Unexpected image format: " << image.type();
     throw std::runtime_error(ss.str());
   }
 
-  VisionMessage msg = VisionMessage(RGBMessage(img_data, image.cols, image.rows), frame_num);
+  // The message shares the pixels with the image (whose data is reference
+  // counted) instead of copying them.
+  cv::Mat const pixels = image.isContinuous() ? image : image.clone();
+  std::shared_ptr<const void> pixel_data(pixels.data, [pixels](const void*) {});
+  VisionMessage msg = VisionMessage(RGBMessage(pixels.data, pixels.cols, pixels.rows), frame_num, pixel_data);
   service_->sendMessage(msg);
 }
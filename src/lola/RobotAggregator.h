@@ -9,9 +9,13 @@
 #include "lola/RobotService.h"
 #include "lola/Robot.h"
 #include <iface_vision_msg.hpp>
+#include <iface_vision_batch.hpp>
+
+#include <map>
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
+#include <boost/make_shared.hpp>
 
 using namespace lepp;
 using am2b_iface::RGBMessage;
@@ -19,7 +23,27 @@ using am2b_iface::VisionMessage;
 using am2b_iface::SurfaceMessage;
 using am2b_iface::ObstacleMessage;
 using am2b_iface::PointCloudMessage;
+using am2b_iface::CompressedPointCloudMessage;
 using am2b_iface::Message_Type;
+using am2b_iface::VisionBatch;
+
+/**
+ * How the `RobotAggregator` sends point clouds.
+ */
+struct PointCloudEncoding {
+  /**
+   * Send the clouds as `CompressedPointCloudMessage`s instead of raw points.
+   */
+  bool compress = false;
+  /**
+   * The quantization step of the coordinates of compressed clouds (m).
+   */
+  float resolution = 0.001f;
+  /**
+   * If positive, compressed clouds keep only one point per voxel of this size (m).
+   */
+  float voxel_size = 0;
+};
 
 /**
  * An `FrameDataObserver` implementation that sends notifications to the robot
@@ -31,26 +55,42 @@ using am2b_iface::Message_Type;
  * that needs to be made is "flattening" a composite model (one made of several
  * primitive models) into its most primitive components and sending msesages for
  * each of those separately to the robot.
+ *
+ * All obstacle and surface updates of a frame are collected into a single
+ * `VisionBatch`, which the service sends as a whole (or as separate messages
+ * to robots that only speak version 1 of the protocol).
  */
 class RobotAggregator : public lepp::FrameDataObserver, public lepp::RGBDataObserver {
 public:
   /**
    * Create a new `RobotAggregator` that will use the given service to
    * communicate to the robot and send status updates after every `freq` frames.
+   * Obstacles are only sent as modified once they changed beyond the
+   * `obstacle_tolerance`.
    */
   RobotAggregator(boost::shared_ptr<RobotService> service,
                   int freq,
                   std::vector<std::string> datatypes,
                   Robot& robot,
                   double min_surface_height = 0,
-                  double surface_normal_tolerance = 0
+                  double surface_normal_tolerance = 0,
+                  PointCloudEncoding const& pointcloud_encoding = PointCloudEncoding(),
+                  ObstacleChangeTolerance const& obstacle_tolerance = ObstacleChangeTolerance()
                 );
   /**
    * `FrameDataObserver` interface implementation.
    */
   void updateFrame(FrameDataPtr frameData) {
-    // Just pass it on to find the diff!
+    // Just pass it on to find the diff! The callbacks collect the updates
+    // in the batch of the frame.
+    batch_ = boost::make_shared<VisionBatch>(frameData->frameNum,
+                                             static_cast<uint64_t>(frameData->timestamp * 1e6));
     diff_.updateFrame(frameData);
+    if (!batch_->empty())
+    {
+      service_->sendBatch(batch_);
+    }
+    batch_.reset();
 
     if (send_pointclouds_)
     {
@@ -110,33 +150,38 @@ private:
   std::vector<ObjectModel*> getPrimitives(ObjectModel& model) const;
 
   /**
-   * Sends a message to the robot informing it of a new model.
+   * Informs the robot of a new model.
    */
   void sendNew(ObjectModel& new_model, int model_id, int part_id, long frame_num);
   /**
-   * Sends a message to the robot informing it of a new surface.
+   * Informs the robot of a new surface.
    */
   void sendNew(SurfaceModel& new_surface, long frame_num);
   /**
-   * Sends a message to the robot informing it of a deleted model.
+   * Informs the robot of a deleted model.
    */
   void sendDeleteObstacle(int id, long frame_num);
   /**
-   * Sends a message to the robot informing it of a deleted part of a model.
+   * Informs the robot of a deleted part of a model.
    */
   void sendDeleteObstaclePart(int model_id, int part_id, long frame_num);
   /**
-   * Sends a message to the robot informing it of a deleted surface.
+   * Informs the robot of a deleted surface.
    */
   void sendDeleteSurface(int id, long frame_num);
   /**
-   * Sends a message to the robot informing it of a modified model.
+   * Informs the robot of a modified model.
    */
   void sendModify(ObjectModel& model, int model_id, int part_id, long frame_num);
   /**
-   * Sends a message to the robot informing it of a modified surface.
+   * Informs the robot of a modified surface.
    */
   void sendModify(SurfaceModel& surface, long frame_num);
+  /**
+   * Adds a new or modified surface to the batch. Surfaces that should not be
+   * considered by the planning system are sent without a hull.
+   */
+  void addSurface(SurfaceModel& surface, uint32_t action);
   /**
    * Sends a point cloud to the remote host
    */
@@ -152,7 +197,7 @@ private:
   int nextId() { return next_id_++; }
   /**
    * Determines whether the given surface should be sent to the planning system.
-   * Surfaces which fail this test have their convex hulls replaced with dummy_hull.
+   * Surfaces which fail this test are sent without a convex hull.
    */
   bool shouldSendSurface(SurfaceModel& model);
 
@@ -169,6 +214,10 @@ private:
    * detect the differences between the checkpoint frames.
    */
   DiffAggregator diff_;
+  /**
+   * The updates of the frame that is currently being processed.
+   */
+  boost::shared_ptr<VisionBatch> batch_;
 
   /**
    * Maps the approximation ID to a list of IDs that the robot will know for
@@ -204,11 +253,9 @@ private:
   double surface_normal_tolerance = 0.0;
 
   /**
-   * A dummy convex hull used to prevent some surfaces from being used by the
-   * planning system. This is sent instead of the original hull to keep all the
-   * surface IDs consistent on both sides.
+   * How point clouds are encoded, if they are sent.
    */
-  PointCloudPtr dummy_hull;
+  PointCloudEncoding pointcloud_encoding_;
 };
 
 #endif
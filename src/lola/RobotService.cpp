@@ -1,21 +1,11 @@
 #include "RobotService.h"
 #include <boost/thread.hpp>
+#include <algorithm>
 
 #include "deps/easylogging++.h"
 #include <iface_msg.hpp>
 
 namespace {
-  /**
-   * Callback invoked when the async connect operation completes.
-   */
-  void connect_handler(boost::system::error_code const& error) {
-    if (!error) {
-      LINFO << "AsyncRobotService: Connected to remote host.";
-    } else {
-      LERROR << "AsyncRobotService:  Failed to connect to the remote host.";
-    }
-  }
-
   /**
    * A simple function that is used to spin up the io service event loop in a
    * dedicated thread.
@@ -29,63 +19,385 @@ namespace {
     io_service->run();
     LINFO << "AsyncRobotService: Exiting service thread...";
   }
-
-  /**
-   * A callback for write operations.
-   */
-  void write_handler(boost::system::error_code const& error,
-               std::size_t sent) {
-    if (!error) {
-      LINFO << "AsyncRobotService: Send complete. "
-            << "Sent " << sent << " bytes.";
-    } else {
-      LERROR << "AsyncRobotService: Error sending message.";
-    }
-  }
 }
 
+int const AsyncRobotService::DEFAULT_BURST;
+int const AsyncRobotService::HELLO_TIMEOUT;
+size_t const AsyncRobotService::DEFAULT_QUEUE_SIZE;
+int const AsyncRobotService::RECONNECT_DELAY;
+int const AsyncRobotService::MAX_RECONNECT_DELAY;
+int const AsyncRobotService::METRICS_INTERVAL;
+
 void AsyncRobotService::start() {
-  // Start it up...
+  connect();
+  metrics_timer_.expires_from_now(boost::posix_time::milliseconds(METRICS_INTERVAL));
+  metrics_timer_.async_wait(boost::bind(&AsyncRobotService::logMetrics, this,
+                                        boost::asio::placeholders::error));
+  // Start the service thread in the background...
+  boost::thread(boost::bind(service_thread, &io_service_));
+}
+
+void AsyncRobotService::connect() {
   boost::asio::ip::tcp::endpoint endpoint(
     boost::asio::ip::address::from_string(remote_), port_);
   LINFO << "AsyncRobotService (" << remoteName_ << "): Initiating a connection asynchronously...";
-  socket_.async_connect(endpoint, connect_handler);
-  // Start the service thread in the background...
-  boost::thread(boost::bind(service_thread, &io_service_));
+  // A socket that failed to connect cannot be reused.
+  boost::system::error_code ignored;
+  socket_.close(ignored);
+  socket_.async_connect(endpoint, boost::bind(&AsyncRobotService::onConnected, this,
+                                              boost::asio::placeholders::error));
+}
+
+void AsyncRobotService::onConnected(boost::system::error_code const& error) {
+  if (error) {
+    LERROR << "AsyncRobotService (" << remoteName_ << "): Failed to connect to the remote host ("
+           << error.message() << "), retrying in " << reconnect_delay_ << " ms.";
+    reconnect_timer_.expires_from_now(boost::posix_time::milliseconds(reconnect_delay_));
+    reconnect_timer_.async_wait([this](boost::system::error_code const& error) {
+      if (!error) connect();
+    });
+    reconnect_delay_ = std::min(2 * reconnect_delay_, static_cast<int>(MAX_RECONNECT_DELAY));
+    return;
+  }
+  LINFO << "AsyncRobotService (" << remoteName_ << "): Connected to remote host.";
+  connected_ = true;
+  reconnect_delay_ = RECONNECT_DELAY;
+
+  if (max_protocol_ <= am2b_iface::VISION_PROTOCOL_V1) {
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      setNegotiated(am2b_iface::VISION_PROTOCOL_V1);
+    }
+    watch();
+    return;
+  }
+
+  // Offer our protocol version and wait for the answer; robots that do not
+  // know about the negotiation ignore the message and never answer.
+  hello_out_.header.id = am2b_iface::VISION_HELLO;
+  hello_out_.header.len = sizeof(am2b_iface::VisionHello);
+  hello_out_.hello.version = max_protocol_;
+  boost::asio::async_write(socket_, boost::asio::buffer(&hello_out_, sizeof(hello_out_)),
+                           [](boost::system::error_code const&, std::size_t) {});
+  boost::asio::async_read(socket_, boost::asio::buffer(&hello_in_, sizeof(hello_in_)),
+                          boost::bind(&AsyncRobotService::onHelloReceived, this,
+                                      boost::asio::placeholders::error));
+  hello_timer_.expires_from_now(boost::posix_time::milliseconds(HELLO_TIMEOUT));
+  hello_timer_.async_wait([this](boost::system::error_code const& error) {
+    // Give up on the answer; the read completes with an error.
+    if (!error) socket_.cancel();
+  });
 }
 
-void AsyncRobotService::inner_send(VisionMessage const& next_message) {
-  am2b_iface::MsgHeader msg_header = { am2b_iface::VISION_MESSAGE, (uint32_t)sizeof(VisionMessageHeader) + next_message.header.len };
-//  LINFO << "AsyncRobotService (" << remoteName_ << "): Sending a queued message: "
-//        << "msg == " << next_message;
-  // Synchronously send the message, i.e. block until the send is complete.
-  try {
-    sendBytes(reinterpret_cast<char const*>(&msg_header), sizeof(msg_header));
-    sendBytes(reinterpret_cast<char const*>(&next_message), sizeof(VisionMessageHeader));
-    sendBytes(next_message.content, next_message.header.len);
-  } catch (...) {
-    LERROR << "AsyncRobotService (" << remoteName_ << "): Error sending message.";
+void AsyncRobotService::onHelloReceived(boost::system::error_code const& error) {
+  hello_timer_.cancel();
+  if (error && error != boost::asio::error::operation_aborted) {
+    // The connection is gone, rather than the answer being overdue.
+    disconnect(error);
+    return;
+  }
+  if (!connected_) {
+    return;
   }
-  // After each sent message, we want to wait a pre-defined amount of time
-  // before sending the next one.
-  // This is because we do not want to overwhelm the robot with a large
-  // number of messages all sent in the same time.
-  boost::this_thread::sleep(message_timeout_);
+
+  uint32_t protocol = am2b_iface::VISION_PROTOCOL_V1;
+  if (!error && hello_in_.header.id == am2b_iface::VISION_HELLO
+      && hello_in_.header.len == sizeof(am2b_iface::VisionHello)) {
+    protocol = std::max(am2b_iface::VISION_PROTOCOL_V1, std::min(max_protocol_, hello_in_.hello.version));
+  }
+  LINFO << "AsyncRobotService (" << remoteName_ << "): Using vision protocol version " << protocol;
+
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    setNegotiated(protocol);
+  }
+  watch();
+}
+
+void AsyncRobotService::watch() {
+  socket_.async_read_some(boost::asio::buffer(watch_buffer_),
+                          [this](boost::system::error_code const& error, std::size_t) {
+    if (!error) {
+      watch();
+    } else if (error != boost::asio::error::operation_aborted) {
+      disconnect(error);
+    }
+  });
 }
 
-void AsyncRobotService::sendBytes(char const* data, size_t length) {
-  size_t sent_bytes = 0;
+void AsyncRobotService::disconnect(boost::system::error_code const& error) {
+  if (!connected_) {
+    return;
+  }
+  connected_ = false;
+  LERROR << "AsyncRobotService (" << remoteName_ << "): Lost the connection to the remote host ("
+         << error.message() << "), reconnecting in " << reconnect_delay_ << " ms.";
 
-  do {
-    sent_bytes += socket_.send(boost::asio::buffer(&data[sent_bytes], length - sent_bytes));
-  } while (sent_bytes < length);
+  // Cancels all pending operations; the write in progress (if any) completes
+  // with an error and the rate limit timer finds the service not negotiated.
+  boost::system::error_code ignored;
+  socket_.close(ignored);
+  hello_timer_.cancel();
+  rate_timer_.cancel();
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    negotiated_ = false;
+    for (size_t i = 0; i < queue_.size(); ++i) {
+      if (!queue_[i].update) ++metrics_.dropped;
+    }
+    queue_.clear();
+    metrics_.queued = 0;
+    // The robot will be sent the whole state after reconnecting.
+    sent_.clear();
+  }
+
+  reconnect_timer_.expires_from_now(boost::posix_time::milliseconds(reconnect_delay_));
+  reconnect_timer_.async_wait([this](boost::system::error_code const& error) {
+    if (!error) connect();
+  });
+}
+
+void AsyncRobotService::setNegotiated(uint32_t protocol) {
+  protocol_ = protocol;
+  negotiated_ = true;
+  ++metrics_.connections;
+
+  // Bring the robot up to date; nothing was queued in the meantime.
+  sent_.clear();
+  if (!state_.empty()) {
+    Outgoing snapshot;
+    snapshot.batch = state_.diff(sent_);
+    snapshot.update = true;
+    queue_.push_back(snapshot);
+    metrics_.queued = queue_.size();
+  }
+
+  if (!queue_.empty() && !flush_scheduled_) {
+    flush_scheduled_ = true;
+    io_service_.post(boost::bind(&AsyncRobotService::flush, this));
+  }
+}
+
+void AsyncRobotService::enqueue(Outgoing& outgoing) {
+  if (outgoing.batch) {
+    state_.apply(*outgoing.batch);
+    outgoing.update = true;
+  } else {
+    outgoing.update = state_.apply(*outgoing.message);
+  }
+  if (!negotiated_) {
+    // The robot gets the updates with the state after connecting.
+    if (!outgoing.update) ++metrics_.dropped;
+    return;
+  }
+
+  queue_.push_back(outgoing);
+  size_t committed = 0;
+  while (committed < queue_.size() && queue_[committed].committed) ++committed;
+  if (queue_.size() - committed > max_queue_) {
+    coalesce();
+  }
+  metrics_.queued = queue_.size();
+  metrics_.max_queued = std::max(metrics_.max_queued, metrics_.queued);
+
+  // If the io_service thread is not about to send messages already, wake it
+  // up to do so.
+  if (!flush_scheduled_) {
+    flush_scheduled_ = true;
+    io_service_.post(boost::bind(&AsyncRobotService::flush, this));
+  }
+}
+
+void AsyncRobotService::coalesce() {
+  std::deque<Outgoing> queued;
+  queued.swap(queue_);
+  size_t i = 0;
+  for (; i < queued.size() && queued[i].committed; ++i) {
+    queue_.push_back(queued[i]);
+  }
+
+  // All updates still waiting turn into the difference between what the
+  // robot was sent and the current state...
+  Outgoing changes;
+  changes.batch = state_.diff(sent_);
+  changes.update = true;
+  if (!changes.batch->empty()) {
+    queue_.push_back(changes);
+  }
+
+  // ...while only the latest of the other messages of each type is kept.
+  std::vector<Outgoing> latest;
+  std::vector<am2b_iface::Message_Type> types;
+  for (size_t j = queued.size(); j-- > i; ) {
+    if (queued[j].update) {
+      ++metrics_.coalesced;
+      continue;
+    }
+    am2b_iface::Message_Type const type = queued[j].message->header.type;
+    if (std::find(types.begin(), types.end(), type) == types.end()) {
+      types.push_back(type);
+      latest.push_back(queued[j]);
+    } else {
+      ++metrics_.dropped;
+    }
+  }
+  queue_.insert(queue_.end(), latest.rbegin(), latest.rend());
 }
 
 void AsyncRobotService::sendMessage(VisionMessage const& msg) {
-  // Just queue another message to be sent by the io_service thread.
-  // Since `inner_send` makes sure to wait after it's finished sending
-  // each message (i.e. the io_service thread is blocked), the queued
-  // messages will all be sent with a preset time delay between subsequent
-  // messages.
-  io_service_.post(boost::bind(&AsyncRobotService::inner_send, this, msg));
+  Outgoing outgoing;
+  outgoing.message.reset(new VisionMessage(msg));
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  enqueue(outgoing);
+}
+
+void AsyncRobotService::sendBatch(boost::shared_ptr<VisionBatch const> const& batch) {
+  Outgoing outgoing;
+  outgoing.batch = batch;
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  enqueue(outgoing);
+}
+
+AsyncRobotService::Metrics AsyncRobotService::metrics() {
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  return metrics_;
+}
+
+void AsyncRobotService::flush() {
+  bool const rate_limited = message_timeout_.total_milliseconds() > 0;
+  if (rate_limited) {
+    refillTokens();
+  }
+
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    if (!negotiated_ || queue_.empty()) {
+      flush_scheduled_ = false;
+      return;
+    }
+
+    // Take as many messages as the rate limit allows, accounting for their
+    // updates in what the robot was sent.
+    size_t count = 0;
+    while (count < queue_.size() && (!rate_limited || tokens_ >= 1)) {
+      Outgoing& outgoing = queue_[count];
+      if (outgoing.update && !outgoing.committed) {
+        if (outgoing.batch) {
+          sent_.apply(*outgoing.batch);
+        } else {
+          sent_.apply(*outgoing.message);
+        }
+        outgoing.committed = true;
+      }
+
+      if (outgoing.batch && protocol_ < am2b_iface::VISION_PROTOCOL_V2) {
+        // Split the batch up in place, the version 1 messages are taken one by one.
+        std::vector<Outgoing> split;
+        am2b_iface::toVisionMessages(*outgoing.batch, [&split](VisionMessage const& msg) {
+          Outgoing part;
+          part.message.reset(new VisionMessage(msg));
+          part.update = part.committed = true;
+          split.push_back(part);
+        });
+        queue_.erase(queue_.begin() + count);
+        queue_.insert(queue_.begin() + count, split.begin(), split.end());
+        continue;
+      }
+
+      ++count;
+      if (rate_limited) {
+        tokens_ -= 1;
+      }
+    }
+
+    if (count == 0) {
+      if (queue_.empty()) {
+        flush_scheduled_ = false;
+        return;
+      }
+      // Wait until the next message can be sent.
+      rate_timer_.expires_from_now(boost::posix_time::microseconds(
+          static_cast<long>((1 - tokens_) * message_timeout_.total_microseconds()) + 1));
+      rate_timer_.async_wait(boost::bind(&AsyncRobotService::flush, this));
+      return;
+    }
+
+    in_flight_.assign(queue_.begin(), queue_.begin() + count);
+    queue_.erase(queue_.begin(), queue_.begin() + count);
+    metrics_.queued = queue_.size();
+    metrics_.sent += count;
+  }
+
+  // Each message goes out as the message header, the vision message header,
+  // the content and the payload (if any); a batch as the message header and
+  // the batch. All of them are gathered into a single write.
+  in_flight_headers_.resize(in_flight_.size());
+  in_flight_buffers_.clear();
+  for (size_t i = 0; i < in_flight_.size(); ++i) {
+    if (in_flight_[i].batch) {
+      VisionBatch const& batch = *in_flight_[i].batch;
+      in_flight_headers_[i].id = am2b_iface::VISION_BATCH;
+      in_flight_headers_[i].len = batch.size();
+      in_flight_buffers_.push_back(boost::asio::buffer(&in_flight_headers_[i], sizeof(am2b_iface::MsgHeader)));
+      in_flight_buffers_.push_back(boost::asio::buffer(batch.data(), batch.size()));
+      continue;
+    }
+
+    VisionMessage const& msg = *in_flight_[i].message;
+    in_flight_headers_[i].id = am2b_iface::VISION_MESSAGE;
+    in_flight_headers_[i].len = (uint32_t)sizeof(VisionMessageHeader) + msg.header.len;
+    in_flight_buffers_.push_back(boost::asio::buffer(&in_flight_headers_[i], sizeof(am2b_iface::MsgHeader)));
+    in_flight_buffers_.push_back(boost::asio::buffer(&msg.header, sizeof(VisionMessageHeader)));
+    in_flight_buffers_.push_back(boost::asio::buffer(msg.content, msg.contentLength()));
+    if (msg.payload_len > 0) {
+      in_flight_buffers_.push_back(boost::asio::buffer(msg.payload.get(), msg.payload_len));
+    }
+  }
+
+  boost::asio::async_write(socket_, in_flight_buffers_,
+                           boost::bind(&AsyncRobotService::onWritten, this,
+                                       boost::asio::placeholders::error));
+}
+
+void AsyncRobotService::onWritten(boost::system::error_code const& error) {
+  in_flight_.clear();
+  if (error) {
+    if (error != boost::asio::error::operation_aborted) {
+      LERROR << "AsyncRobotService (" << remoteName_ << "): Error sending messages: " << error.message();
+    }
+    disconnect(error);
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    flush_scheduled_ = false;
+    return;
+  }
+  // Keep going until the queue is drained.
+  flush();
+}
+
+void AsyncRobotService::refillTokens() {
+  boost::posix_time::ptime const now = boost::posix_time::microsec_clock::universal_time();
+  if (last_refill_.is_not_a_date_time()) {
+    last_refill_ = now;
+  }
+  double const elapsed = (now - last_refill_).total_microseconds();
+  tokens_ = std::min<double>(burst_, tokens_ + elapsed / message_timeout_.total_microseconds());
+  last_refill_ = now;
+}
+
+void AsyncRobotService::logMetrics(boost::system::error_code const& error) {
+  if (error) {
+    return;
+  }
+  Metrics const current = metrics();
+  if (current.coalesced != logged_metrics_.coalesced || current.dropped != logged_metrics_.dropped) {
+    LINFO << "AsyncRobotService (" << remoteName_ << "): " << current.queued << " messages queued (at most "
+          << current.max_queued << "), " << current.sent << " sent, "
+          << current.coalesced - logged_metrics_.coalesced << " updates coalesced and "
+          << current.dropped - logged_metrics_.dropped << " messages dropped in the last "
+          << METRICS_INTERVAL / 1000 << " s";
+    logged_metrics_ = current;
+  }
+  metrics_timer_.expires_at(metrics_timer_.expires_at() + boost::posix_time::milliseconds(METRICS_INTERVAL));
+  metrics_timer_.async_wait(boost::bind(&AsyncRobotService::logMetrics, this,
+                                        boost::asio::placeholders::error));
 }
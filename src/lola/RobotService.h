@@ -2,10 +2,18 @@
 #define LOLA_ROBOT_SERVICE_H__
 
 #include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <vector>
+#include "iface_msg.hpp"
 #include "iface_vision_msg.hpp"
+#include "iface_vision_batch.hpp"
+#include "lola/VisionState.h"
 
+using am2b_iface::VisionBatch;
 using am2b_iface::VisionMessage;
 using am2b_iface::VisionMessageHeader;
 
@@ -23,6 +31,15 @@ public:
    * or not.
    */
   virtual void sendMessage(VisionMessage const& msg) = 0;
+  /**
+   * Send all obstacle and surface updates of a frame to the robot.
+   *
+   * Unless the concrete `RobotService` can send the batch as a whole, its
+   * updates are sent as separate (version 1) messages.
+   */
+  virtual void sendBatch(boost::shared_ptr<VisionBatch const> const& batch) {
+    am2b_iface::toVisionMessages(*batch, [this](VisionMessage const& msg) { sendMessage(msg); });
+  }
 };
 
 /**
@@ -30,6 +47,28 @@ public:
  * to the robot.
  *
  * It allows clients to asychronously send vision messages to the robot.
+ *
+ * Messages are queued and the io_service thread writes everything that is
+ * queued with a single gather write. The rate of the messages is limited by a
+ * token bucket: on average, one message is sent per `delay` milliseconds, but
+ * up to `burst` messages can go out at once.
+ *
+ * After connecting, the service negotiates the vision protocol version with
+ * the robot (see iface_vision_batch.hpp). With version 2, a batch goes out
+ * as a single message; with version 1, it is split up into one message per
+ * update.
+ *
+ * The service keeps track of the obstacles and surfaces that the updates
+ * create, and of the ones the robot was sent. While there is no connection,
+ * updates only change the former, and other messages (point clouds, images)
+ * are dropped. Lost connections are reestablished, and once the protocol is
+ * negotiated, the robot is sent everything it needs to catch up.
+ *
+ * The queue holds at most `queue_size` messages. If the robot does not keep
+ * up, the queued updates are replaced by the difference between what the
+ * robot was sent and the current state, so that it gets only the latest
+ * state of each obstacle part and surface, and only the latest message of
+ * each other type is kept.
  */
 class AsyncRobotService : public RobotService {
 public:
@@ -40,22 +79,73 @@ public:
    * No delay between subsequent messages is set.
    */
   AsyncRobotService(std::string const& remote, int port)
-      : remote_(remote), port_(port), socket_(io_service_),
-        message_timeout_(0) {}
+      : AsyncRobotService(remote, "", port, 0) {}
 
   /**
    * Creates a new `AsyncRobotService` instance that will try to send messages
    * to a robot on the given remote address (host name, port combination).
    *
-   * The delay between each subsequent sent message is set by the `delay`
-   * parameter.
+   * The average delay between subsequent sent messages is set by the `delay`
+   * parameter, with bursts of up to `burst` messages being sent without any
+   * delay.
    */
   AsyncRobotService(std::string const& remote, int port, int delay)
-      : remote_(remote), port_(port), socket_(io_service_),
-        message_timeout_(delay) {}
-  AsyncRobotService(std::string const& remote, std::string const& remoteName, int port, int delay)
+      : AsyncRobotService(remote, "", port, delay) {}
+  /**
+   * The highest protocol version offered to the robot is given by `protocol`;
+   * with version 1, no negotiation takes place.
+   */
+  AsyncRobotService(std::string const& remote, std::string const& remoteName, int port, int delay,
+                    int burst = DEFAULT_BURST, uint32_t protocol = am2b_iface::VISION_PROTOCOL_V2,
+                    size_t queue_size = DEFAULT_QUEUE_SIZE)
       : remote_(remote), remoteName_(remoteName), port_(port), socket_(io_service_),
-        message_timeout_(delay) {}
+        connected_(false), reconnect_timer_(io_service_), reconnect_delay_(RECONNECT_DELAY),
+        message_timeout_(delay), burst_(burst), rate_timer_(io_service_),
+        tokens_(burst), max_protocol_(protocol), protocol_(am2b_iface::VISION_PROTOCOL_V1),
+        hello_timer_(io_service_), max_queue_(queue_size), negotiated_(false),
+        flush_scheduled_(false), metrics_(), logged_metrics_(), metrics_timer_(io_service_) {}
+
+  /**
+   * The default number of messages that can be sent at once.
+   */
+  static int const DEFAULT_BURST = 50;
+  /**
+   * How long to wait for the robot to answer the protocol negotiation (ms).
+   */
+  static int const HELLO_TIMEOUT = 1000;
+  /**
+   * The default maximum number of queued messages.
+   */
+  static size_t const DEFAULT_QUEUE_SIZE = 64;
+  /**
+   * How long to wait before reconnecting (ms). The delay doubles with every
+   * failed attempt, up to `MAX_RECONNECT_DELAY`.
+   */
+  static int const RECONNECT_DELAY = 1000;
+  static int const MAX_RECONNECT_DELAY = 16000;
+  /**
+   * How often the metrics are logged when messages had to be coalesced or
+   * dropped (ms).
+   */
+  static int const METRICS_INTERVAL = 10000;
+
+  /**
+   * Counters of the queue.
+   */
+  struct Metrics {
+    // number of queued messages, now and at most
+    size_t queued;
+    size_t max_queued;
+    // number of messages written to the robot
+    uint64_t sent;
+    // number of queued updates that were replaced by the difference to the current state
+    uint64_t coalesced;
+    // number of other messages that were dropped, as newer ones were queued or there was no connection
+    uint64_t dropped;
+    // number of established connections
+    uint32_t connections;
+  };
+
   /**
    * Starts up the service, initiating a connection to the robot.
    *
@@ -69,7 +159,46 @@ public:
    * The call never blocks.
    */
   void sendMessage(VisionMessage const& msg);
+  /**
+   * Asynchronously sends the updates of a frame to the robot.
+   *
+   * The call never blocks.
+   */
+  void sendBatch(boost::shared_ptr<VisionBatch const> const& batch);
+  /**
+   * The current metrics of the queue.
+   */
+  Metrics metrics();
 private:
+  /**
+   * A queued message: either a single vision message or a batch.
+   */
+  struct Outgoing {
+    Outgoing() : update(false), committed(false) {}
+
+    boost::shared_ptr<VisionMessage const> message;
+    boost::shared_ptr<VisionBatch const> batch;
+    /**
+     * Whether the message changes obstacles or surfaces.
+     */
+    bool update;
+    /**
+     * Whether the update is already accounted for in what the robot was sent.
+     * Such messages (the parts of a batch split up for version 1) are always
+     * at the front of the queue and are never coalesced.
+     */
+    bool committed;
+  };
+  /**
+   * The protocol negotiation messages, as sent over the wire.
+   */
+#pragma pack(push,1)
+  struct Hello {
+    am2b_iface::MsgHeader header;
+    am2b_iface::VisionHello hello;
+  };
+#pragma pack(pop)
+
   /**
    * The host name to send data to.
    */
@@ -90,24 +219,147 @@ private:
    * The socket that is connected to the remote robot endpoint.
    */
   boost::asio::ip::tcp::socket socket_;
+  /**
+   * Whether the socket is connected. Only used on the io_service thread.
+   */
+  bool connected_;
+  /**
+   * Waits for the next connection attempt, and the current delay (ms).
+   */
+  boost::asio::deadline_timer reconnect_timer_;
+  int reconnect_delay_;
+  /**
+   * Receives whatever the robot sends after the negotiation; only used to
+   * notice when the connection is closed.
+   */
+  char watch_buffer_[64];
 
   /**
-   * A number of milliseconds that the service waits between subsequent
-   * messages that it sends to the robot.
+   * The average number of milliseconds between subsequent messages that the
+   * service sends to the robot.
    */
   boost::posix_time::milliseconds message_timeout_;
+  /**
+   * The maximum number of messages that are sent at once.
+   */
+  int const burst_;
+  /**
+   * Wakes up the io_service thread when the rate limit allows sending again.
+   */
+  boost::asio::deadline_timer rate_timer_;
+  /**
+   * The number of messages that can currently be sent without waiting, and
+   * the time this number was last updated.
+   */
+  double tokens_;
+  boost::posix_time::ptime last_refill_;
+
+  /**
+   * The highest protocol version offered to the robot and the negotiated one.
+   */
+  uint32_t const max_protocol_;
+  uint32_t protocol_;
+  /**
+   * The negotiation messages sent and received, and the timer that gives up
+   * waiting for the answer.
+   */
+  Hello hello_out_;
+  Hello hello_in_;
+  boost::asio::deadline_timer hello_timer_;
+
+  /**
+   * The messages waiting to be sent. Shared between the io_service thread
+   * and the callers of `sendMessage`, protected by the `queue_mutex_`, like
+   * all of the members up to the `queue_mutex_`.
+   */
+  std::deque<Outgoing> queue_;
+  size_t const max_queue_;
+  /**
+   * The obstacles and surfaces of all updates, and of the updates the robot
+   * was sent (including the ones being written).
+   */
+  VisionState state_;
+  VisionState sent_;
+  /**
+   * Whether the protocol version is known, so that messages can be sent.
+   */
+  bool negotiated_;
+  /**
+   * Whether the io_service thread is going to pick up the queued messages,
+   * i.e. a flush is posted, waiting for the rate limit or writing.
+   */
+  bool flush_scheduled_;
+  Metrics metrics_;
+  boost::mutex queue_mutex_;
+
+  /**
+   * The metrics when they were logged last, and the timer for logging them.
+   */
+  Metrics logged_metrics_;
+  boost::asio::deadline_timer metrics_timer_;
+
+  /**
+   * The messages of the write in progress, along with their message headers
+   * and the buffers that point into both.
+   */
+  std::vector<Outgoing> in_flight_;
+  std::vector<am2b_iface::MsgHeader> in_flight_headers_;
+  std::vector<boost::asio::const_buffer> in_flight_buffers_;
 
   /**
-   * A helper function that performs the send of the message and then waits
-   * the predefined amount of time before returning. This way, the wait blocks
-   * the (io_service) thread and causes the next message that should be sent
-   * to be delayed the necessary amount of time.
+   * Starts a connection attempt.
+   */
+  void connect();
+  /**
+   * Completion handler of the connection attempt; starts the negotiation.
+   */
+  void onConnected(boost::system::error_code const& error);
+  /**
+   * Closes the connection after an error, drops the queued messages and
+   * schedules a new connection attempt.
+   */
+  void disconnect(boost::system::error_code const& error);
+  /**
+   * Reads from the socket until the connection is closed.
+   */
+  void watch();
+  /**
+   * Completion handler of reading the answer of the robot to the negotiation.
+   */
+  void onHelloReceived(boost::system::error_code const& error);
+  /**
+   * Fixes the protocol version and starts sending the current state.
+   * Called with the queue mutex held.
+   */
+  void setNegotiated(uint32_t protocol);
+  /**
+   * Applies the message to the state and appends it to the queue, if there
+   * is a connection. Called with the queue mutex held.
+   */
+  void enqueue(Outgoing& outgoing);
+  /**
+   * Shrinks the queue as described above. Called with the queue mutex held.
+   */
+  void coalesce();
+  /**
+   * Sends as many of the queued messages as the rate limit allows with a
+   * single write. Runs on the io_service thread, which it keeps busy until
+   * the queue is drained.
+   */
+  void flush();
+  /**
+   * Completion handler of the writes started by `flush`.
+   */
+  void onWritten(boost::system::error_code const& error);
+  /**
+   * Adds the tokens of the time passed since the last refill to the bucket.
    */
-  void inner_send(VisionMessage const& msg);
+  void refillTokens();
   /**
-   * Helper method to send all bytes to the remote socket. To be used in inner_send.
+   * Logs the metrics if messages were coalesced or dropped since the last
+   * time, then waits for the next time.
    */
-  void sendBytes(char const* buffer, size_t length);
+  void logMetrics(boost::system::error_code const& error);
 };
 
 #endif
@@ -0,0 +1,89 @@
+#include "ShmRobotService.h"
+
+#include <stdexcept>
+
+#include "deps/easylogging++.h"
+
+ShmRobotService::ShmRobotService(std::string const& name, uint64_t capacity, int keyframe_interval)
+    : name_(name),
+      keyframe_interval_(keyframe_interval), keyframe_timer_(io_service_) {
+  if (!writer_.create(name, capacity)) {
+    throw std::runtime_error("ShmRobotService: Could not create shared memory " + name + ": " + strerror(errno));
+  }
+  LINFO << "ShmRobotService: Writing to shared memory " << name
+        << " (" << (writer_.capacity() >> 20) << " MB)";
+}
+
+ShmRobotService::~ShmRobotService() {
+  io_service_.stop();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ShmRobotService::start() {
+  keyframe_timer_.expires_from_now(keyframe_interval_);
+  keyframe_timer_.async_wait(boost::bind(&ShmRobotService::writeKeyframe, this,
+                                         boost::asio::placeholders::error));
+  thread_ = boost::thread([this]() { io_service_.run(); });
+}
+
+void ShmRobotService::sendMessage(VisionMessage const& msg) {
+  am2b_iface::MsgHeader header;
+  header.id = am2b_iface::VISION_MESSAGE;
+  header.len = sizeof(VisionMessageHeader) + msg.header.len;
+  iovec parts[3] = {
+    { const_cast<VisionMessageHeader*>(&msg.header), sizeof(VisionMessageHeader) },
+    { msg.content, msg.contentLength() },
+    { const_cast<void*>(msg.payload.get()), msg.payload_len },
+  };
+
+  boost::mutex::scoped_lock lock(mutex_);
+  state_.apply(msg);
+  write(header, parts, msg.payload_len > 0 ? 3 : 2, 0);
+}
+
+void ShmRobotService::sendBatch(boost::shared_ptr<VisionBatch const> const& batch) {
+  am2b_iface::MsgHeader header;
+  header.id = am2b_iface::VISION_BATCH;
+  header.len = batch->size();
+  iovec parts[1] = {
+    { const_cast<char*>(batch->data()), batch->size() },
+  };
+
+  boost::mutex::scoped_lock lock(mutex_);
+  state_.apply(*batch);
+  write(header, parts, 1, 0);
+}
+
+void ShmRobotService::write(am2b_iface::MsgHeader const& header, iovec* parts, int count, uint32_t flags) {
+  iovec message[4] = { { const_cast<am2b_iface::MsgHeader*>(&header), sizeof(header) } };
+  std::copy(parts, parts + count, message + 1);
+
+  if (!writer_.write(message, count + 1, flags)) {
+    LERROR << "ShmRobotService: Message of " << header.len << " bytes does not fit into " << name_;
+  }
+}
+
+void ShmRobotService::writeKeyframe(boost::system::error_code const& error) {
+  if (error) {
+    return;
+  }
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    // The keyframe creates everything.
+    boost::shared_ptr<VisionBatch> const keyframe = state_.diff(VisionState());
+    am2b_iface::MsgHeader header;
+    header.id = am2b_iface::VISION_BATCH;
+    header.len = keyframe->size();
+    iovec parts[1] = {
+      { const_cast<char*>(keyframe->data()), keyframe->size() },
+    };
+    write(header, parts, 1, am2b_iface::VISION_SHM_KEYFRAME);
+  }
+
+  keyframe_timer_.expires_at(keyframe_timer_.expires_at() + keyframe_interval_);
+  keyframe_timer_.async_wait(boost::bind(&ShmRobotService::writeKeyframe, this,
+                                         boost::asio::placeholders::error));
+}
@@ -0,0 +1,88 @@
+#ifndef LOLA_SHM_ROBOT_SERVICE_H__
+#define LOLA_SHM_ROBOT_SERVICE_H__
+
+#include "lola/RobotService.h"
+#include "lola/VisionState.h"
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <iface_vision_shm.hpp>
+
+/**
+ * A `RobotService` that hands the vision messages to consumers on the same
+ * machine through a POSIX shared memory ring buffer (see
+ * iface_vision_shm.hpp), saving the copies and system calls of a local TCP
+ * connection.
+ *
+ * Messages are written from the calling thread and never wait for the
+ * consumers; consumers that fall too far behind lose messages. Batches are
+ * written as a whole (protocol version 2). The service keeps track of the
+ * obstacles and surfaces that the written batches create, modify and delete,
+ * and writes all of them in a keyframe every `keyframe_interval`
+ * milliseconds, so that consumers that started late or lost messages can
+ * recover.
+ */
+class ShmRobotService : public RobotService {
+public:
+  /**
+   * Creates the shared memory object with the given name and a ring buffer of
+   * at least `capacity` bytes. Throws if that fails.
+   */
+  ShmRobotService(std::string const& name, uint64_t capacity = DEFAULT_CAPACITY,
+                  int keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+  ~ShmRobotService();
+
+  /**
+   * The default size of the ring buffer (bytes), enough for a few frames of
+   * point clouds and images.
+   */
+  static uint64_t const DEFAULT_CAPACITY = 64 << 20;
+  /**
+   * The default time between two keyframes (ms).
+   */
+  static int const DEFAULT_KEYFRAME_INTERVAL = 1000;
+
+  /**
+   * Starts writing the keyframes, on a dedicated thread.
+   */
+  void start();
+  /**
+   * Writes the message to the buffer.
+   */
+  void sendMessage(VisionMessage const& msg);
+  /**
+   * Writes the changes of a frame to the buffer as a single message.
+   */
+  void sendBatch(boost::shared_ptr<VisionBatch const> const& batch);
+private:
+  /**
+   * Writes the message with the given header and content. Called with the
+   * mutex held.
+   */
+  void write(am2b_iface::MsgHeader const& header, iovec* parts, int count, uint32_t flags);
+  /**
+   * Writes a keyframe, then waits for the next one.
+   */
+  void writeKeyframe(boost::system::error_code const& error);
+
+  std::string const name_;
+  boost::asio::io_service io_service_;
+  boost::posix_time::milliseconds const keyframe_interval_;
+  boost::asio::deadline_timer keyframe_timer_;
+  boost::thread thread_;
+
+  /**
+   * Protects everything below. There is only one writer per buffer, so
+   * messages sent from several threads, and the keyframes from the service
+   * thread, take turns.
+   */
+  boost::mutex mutex_;
+  am2b_iface::VisionShmWriter writer_;
+  /**
+   * The obstacles and surfaces that the written messages created.
+   */
+  VisionState state_;
+};
+
+#endif
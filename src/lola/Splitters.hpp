@@ -6,9 +6,6 @@
 #include "lepp3/models/Coordinate.h"
 #include "lola/Robot.h"
 
-#include <pcl/common/pca.h>
-#include <pcl/common/common.h>
-
 using namespace lepp;
 
 /**
@@ -29,7 +26,9 @@ public:
           robot_(robot) {}
   bool shouldSplit(
       int split_depth,
-      const PointCloudConstPtr& point_cloud);
+      const PointRange& points,
+      const GeometryDescriptor& geometry,
+      const ObjectModelPtr& model);
 private:
   /**
    * The square of the distance threshold at which we will stop splitting
@@ -47,15 +46,14 @@ private:
 
 bool DistanceThresholdSplitCondition::shouldSplit(
     int split_depth,
-    const PointCloudConstPtr& point_cloud) {
+    const PointRange& points,
+    const GeometryDescriptor& geometry,
+    const ObjectModelPtr& model) {
   // The distance should be in [cm] so we need to scale up the original points
   // (as they are in [m])
   Coordinate const robot_position = 100 * robot_.robot_position();
-  // Compute the centroid of the pointcloud -> approx position of the object
-  Eigen::Vector4d centroid_4d;
-  pcl::compute3DCentroid(*point_cloud, centroid_4d);
-  Coordinate const centroid(
-      100 * centroid_4d[0], 100 * centroid_4d[1], 100 * centroid_4d[2]);
+  // The centroid of the pointcloud -> approx position of the object
+  Coordinate const centroid = 100 * Coordinate(geometry.centroid);
   // Now find he distance between the robot's location and the centroid of the
   // cloud, giving an estimate of how far the robot is from the object.
   int const dist = (robot_position - centroid).square_norm();
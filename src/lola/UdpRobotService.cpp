@@ -0,0 +1,136 @@
+#include "UdpRobotService.h"
+
+#include <stdexcept>
+
+#include "deps/easylogging++.h"
+
+namespace {
+/**
+ * The number of message bytes in a datagram of the given size.
+ */
+size_t fragmentSize(int datagram_size) {
+  if (datagram_size <= static_cast<int>(sizeof(am2b_iface::VisionDatagramHeader))) {
+    throw std::runtime_error("UdpRobotService: The datagram size must be larger than the datagram header");
+  }
+  return datagram_size - sizeof(am2b_iface::VisionDatagramHeader);
+}
+}
+
+UdpRobotService::UdpRobotService(std::string const& address, int port,
+                                 int keyframe_interval, int datagram_size, int ttl)
+    : socket_(io_service_),
+      endpoint_(boost::asio::ip::address::from_string(address), port),
+      keyframe_interval_(keyframe_interval), keyframe_timer_(io_service_),
+      fragment_size_(fragmentSize(datagram_size)),
+      sequence_(0) {
+  socket_.open(endpoint_.protocol());
+  if (endpoint_.address().is_multicast()) {
+    socket_.set_option(boost::asio::ip::multicast::hops(ttl));
+    socket_.set_option(boost::asio::ip::multicast::enable_loopback(true));
+  }
+  datagram_header_.magic = am2b_iface::VISION_DATAGRAM_MAGIC;
+}
+
+UdpRobotService::~UdpRobotService() {
+  io_service_.stop();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void UdpRobotService::start() {
+  LINFO << "UdpRobotService: Publishing to " << endpoint_;
+  keyframe_timer_.expires_from_now(keyframe_interval_);
+  keyframe_timer_.async_wait(boost::bind(&UdpRobotService::publishKeyframe, this,
+                                         boost::asio::placeholders::error));
+  thread_ = boost::thread([this]() { io_service_.run(); });
+}
+
+void UdpRobotService::sendMessage(VisionMessage const& msg) {
+  std::vector<boost::asio::const_buffer> content;
+  content.push_back(boost::asio::buffer(&msg.header, sizeof(VisionMessageHeader)));
+  content.push_back(boost::asio::buffer(msg.content, msg.contentLength()));
+  if (msg.payload_len > 0) {
+    content.push_back(boost::asio::buffer(msg.payload.get(), msg.payload_len));
+  }
+  am2b_iface::MsgHeader header;
+  header.id = am2b_iface::VISION_MESSAGE;
+  header.len = sizeof(VisionMessageHeader) + msg.header.len;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  state_.apply(msg);
+  publish(header, content, 0);
+}
+
+void UdpRobotService::sendBatch(boost::shared_ptr<VisionBatch const> const& batch) {
+  am2b_iface::MsgHeader header;
+  header.id = am2b_iface::VISION_BATCH;
+  header.len = batch->size();
+  std::vector<boost::asio::const_buffer> content(1, boost::asio::buffer(batch->data(), batch->size()));
+
+  boost::mutex::scoped_lock lock(mutex_);
+  state_.apply(*batch);
+  publish(header, content, 0);
+}
+
+void UdpRobotService::publish(am2b_iface::MsgHeader const& header,
+                              std::vector<boost::asio::const_buffer> const& content, uint32_t flags) {
+  std::vector<boost::asio::const_buffer> message(1, boost::asio::buffer(&header, sizeof(header)));
+  message.insert(message.end(), content.begin(), content.end());
+  size_t const length = boost::asio::buffer_size(message);
+
+  datagram_header_.sequence = sequence_++;
+  datagram_header_.length = length;
+  datagram_header_.flags = flags;
+
+  // Each datagram carries the next fragment_size_ bytes of the message, which
+  // may span several of its buffers.
+  size_t buffer = 0;
+  size_t buffer_offset = 0;
+  for (size_t offset = 0; offset < length; ) {
+    datagram_header_.offset = offset;
+    datagram_buffers_.assign(1, boost::asio::buffer(&datagram_header_, sizeof(datagram_header_)));
+    size_t fragment = 0;
+    while (fragment < fragment_size_ && offset < length) {
+      size_t const available = boost::asio::buffer_size(message[buffer]) - buffer_offset;
+      size_t const n = std::min(available, fragment_size_ - fragment);
+      datagram_buffers_.push_back(boost::asio::buffer(message[buffer] + buffer_offset, n));
+      fragment += n;
+      offset += n;
+      buffer_offset += n;
+      if (buffer_offset == boost::asio::buffer_size(message[buffer])) {
+        ++buffer;
+        buffer_offset = 0;
+      }
+    }
+
+    boost::system::error_code error;
+    socket_.send_to(datagram_buffers_, endpoint_, 0, error);
+    if (error) {
+      LERROR << "UdpRobotService: Error sending message " << datagram_header_.sequence
+             << ": " << error.message();
+      return;
+    }
+  }
+}
+
+void UdpRobotService::publishKeyframe(boost::system::error_code const& error) {
+  if (error) {
+    return;
+  }
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    // The keyframe creates everything.
+    boost::shared_ptr<VisionBatch> const keyframe = state_.diff(VisionState());
+    am2b_iface::MsgHeader header;
+    header.id = am2b_iface::VISION_BATCH;
+    header.len = keyframe->size();
+    std::vector<boost::asio::const_buffer> content(1, boost::asio::buffer(keyframe->data(), keyframe->size()));
+    publish(header, content, am2b_iface::VISION_DATAGRAM_KEYFRAME);
+  }
+
+  keyframe_timer_.expires_at(keyframe_timer_.expires_at() + keyframe_interval_);
+  keyframe_timer_.async_wait(boost::bind(&UdpRobotService::publishKeyframe, this,
+                                         boost::asio::placeholders::error));
+}
@@ -0,0 +1,108 @@
+#ifndef LOLA_UDP_ROBOT_SERVICE_H__
+#define LOLA_UDP_ROBOT_SERVICE_H__
+
+#include "lola/RobotService.h"
+#include "lola/VisionState.h"
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+#include <iface_vision_udp.hpp>
+
+/**
+ * A `RobotService` that publishes the vision messages over UDP, to a multicast
+ * group (or a single host), so that any number of receivers can subscribe
+ * while every message is serialized and sent only once.
+ *
+ * The messages are split into datagrams as described in iface_vision_udp.hpp.
+ * The service keeps track of the obstacles and surfaces that the published
+ * batches create, modify and delete, and publishes all of them in a keyframe
+ * every `keyframe_interval` milliseconds, so that receivers that joined late
+ * or lost messages can recover.
+ *
+ * Messages are sent from the calling thread; UDP sends do not wait for the
+ * receivers.
+ */
+class UdpRobotService : public RobotService {
+public:
+  /**
+   * Creates a new `UdpRobotService` publishing to the given address (a
+   * multicast group or a host) and port. Multicast datagrams are sent with
+   * the given TTL, i.e. number of hops.
+   *
+   * Throws a `runtime_error` if the datagrams are too small to carry any of
+   * the message.
+   */
+  UdpRobotService(std::string const& address, int port,
+                  int keyframe_interval = DEFAULT_KEYFRAME_INTERVAL,
+                  int datagram_size = DEFAULT_DATAGRAM_SIZE,
+                  int ttl = 1);
+  ~UdpRobotService();
+
+  /**
+   * The default time between two keyframes (ms).
+   */
+  static int const DEFAULT_KEYFRAME_INTERVAL = 1000;
+  /**
+   * The default maximum size of the datagrams (bytes).
+   */
+  static int const DEFAULT_DATAGRAM_SIZE = 8192;
+
+  /**
+   * Starts publishing the keyframes, on a dedicated thread.
+   */
+  void start();
+  /**
+   * Publishes the message.
+   */
+  void sendMessage(VisionMessage const& msg);
+  /**
+   * Publishes the changes of a frame.
+   */
+  void sendBatch(boost::shared_ptr<VisionBatch const> const& batch);
+private:
+  /**
+   * Splits the message with the given header and content into datagrams and
+   * sends them. Called with the mutex held.
+   */
+  void publish(am2b_iface::MsgHeader const& header,
+               std::vector<boost::asio::const_buffer> const& content, uint32_t flags);
+  /**
+   * Publishes a keyframe, then waits for the next one.
+   */
+  void publishKeyframe(boost::system::error_code const& error);
+
+  boost::asio::io_service io_service_;
+  boost::asio::ip::udp::socket socket_;
+  boost::asio::ip::udp::endpoint endpoint_;
+  boost::posix_time::milliseconds const keyframe_interval_;
+  boost::asio::deadline_timer keyframe_timer_;
+  boost::thread thread_;
+  /**
+   * The maximum number of message bytes in a datagram.
+   */
+  size_t const fragment_size_;
+
+  /**
+   * Protects everything below, since messages are published from the
+   * pipeline and the keyframes from the service thread.
+   */
+  boost::mutex mutex_;
+  /**
+   * The number of the next message.
+   */
+  uint32_t sequence_;
+  /**
+   * The datagram header and the buffers of the fragment being sent.
+   */
+  am2b_iface::VisionDatagramHeader datagram_header_;
+  std::vector<boost::asio::const_buffer> datagram_buffers_;
+
+  /**
+   * The obstacles and surfaces that the published messages created.
+   */
+  VisionState state_;
+};
+
+#endif
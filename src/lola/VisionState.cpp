@@ -0,0 +1,143 @@
+#include "VisionState.h"
+
+#include <cstring>
+
+using am2b_iface::ObstacleMessage;
+using am2b_iface::SurfaceMessage;
+using am2b_iface::SurfaceRecord;
+using am2b_iface::VisionBatch;
+using am2b_iface::VisionBatchReader;
+using am2b_iface::VisionMessage;
+
+namespace {
+  bool sameShape(ObstacleMessage const& a, ObstacleMessage const& b) {
+    return a.type == b.type && a.radius == b.radius
+        && memcmp(a.coeffs, b.coeffs, sizeof(a.coeffs)) == 0;
+  }
+}
+
+void VisionState::apply(VisionBatch const& batch) {
+  VisionBatchReader reader(batch.data(), batch.size());
+  frame_ = reader.header().frame;
+  timestamp_ = reader.header().timestamp;
+
+  std::vector<float> vertices;
+  while (reader.next()) {
+    if (reader.type() == am2b_iface::Message_Type::Obstacle) {
+      ObstacleMessage obstacle;
+      if (reader.read(obstacle)) apply(obstacle);
+    } else if (reader.type() == am2b_iface::Message_Type::Surface) {
+      SurfaceRecord surface;
+      if (reader.read(surface, vertices)) apply(surface, vertices);
+    }
+  }
+}
+
+bool VisionState::apply(VisionMessage const& msg) {
+  if (msg.header.type == am2b_iface::Message_Type::Obstacle) {
+    ObstacleMessage obstacle;
+    memcpy(&obstacle, msg.content, sizeof(obstacle));
+    frame_ = msg.header.frame;
+    apply(obstacle);
+    return true;
+  }
+  if (msg.header.type == am2b_iface::Message_Type::Surface) {
+    SurfaceMessage message;
+    memcpy(&message, msg.content, sizeof(message));
+    SurfaceRecord surface;
+    surface.action = message.action;
+    surface.id = message.id;
+    memcpy(surface.normal, message.normal, sizeof(surface.normal));
+    surface.vertex_count = 8;
+    frame_ = msg.header.frame;
+    apply(surface, std::vector<float>(message.vertices, message.vertices + 3 * 8));
+    return true;
+  }
+  return false;
+}
+
+void VisionState::apply(ObstacleMessage const& obstacle) {
+  if (obstacle.action == am2b_iface::REMOVE_SSV_WHOLE_SEGMENT) {
+    obstacles_.erase(obstacles_.lower_bound(std::make_pair(obstacle.model_id, 0u)),
+                     obstacles_.upper_bound(std::make_pair(obstacle.model_id, ~0u)));
+  } else if (obstacle.action == am2b_iface::REMOVE_SSV_ONLY_PART) {
+    obstacles_.erase(std::make_pair(obstacle.model_id, obstacle.part_id));
+  } else {
+    obstacles_[std::make_pair(obstacle.model_id, obstacle.part_id)] = obstacle;
+  }
+}
+
+void VisionState::apply(SurfaceRecord const& surface, std::vector<float> const& vertices) {
+  if (surface.action == am2b_iface::REMOVE_SURFACE) {
+    surfaces_.erase(surface.id);
+  } else {
+    Surface& entry = surfaces_[surface.id];
+    entry.record = surface;
+    entry.vertices = vertices;
+  }
+}
+
+void VisionState::clear() {
+  obstacles_.clear();
+  surfaces_.clear();
+}
+
+bool VisionState::hasModel(ObstacleMap const& obstacles, uint32_t model_id) {
+  ObstacleMap::const_iterator it = obstacles.lower_bound(std::make_pair(model_id, 0u));
+  return it != obstacles.end() && it->first.first == model_id;
+}
+
+boost::shared_ptr<VisionBatch> VisionState::diff(VisionState const& previous) const {
+  boost::shared_ptr<VisionBatch> batch(new VisionBatch(frame_, timestamp_));
+
+  // Removed models and parts
+  for (ObstacleMap::const_iterator it = previous.obstacles_.begin(); it != previous.obstacles_.end(); ) {
+    uint32_t const model_id = it->first.first;
+    ObstacleMap::const_iterator const next_model = previous.obstacles_.upper_bound(std::make_pair(model_id, ~0u));
+    if (!hasModel(obstacles_, model_id)) {
+      batch->addObstacle(ObstacleMessage::DeleteMessage(model_id));
+    } else {
+      for (; it != next_model; ++it) {
+        if (obstacles_.find(it->first) == obstacles_.end()) {
+          batch->addObstacle(ObstacleMessage::DeletePartMessage(model_id, it->first.second));
+        }
+      }
+    }
+    it = next_model;
+  }
+
+  // New models, new and changed parts
+  for (ObstacleMap::const_iterator it = obstacles_.begin(); it != obstacles_.end(); ) {
+    uint32_t const model_id = it->first.first;
+    ObstacleMap::const_iterator const next_model = obstacles_.upper_bound(std::make_pair(model_id, ~0u));
+    bool const new_model = !hasModel(previous.obstacles_, model_id);
+    for (bool first = true; it != next_model; ++it, first = false) {
+      ObstacleMap::const_iterator const old = previous.obstacles_.find(it->first);
+      if (new_model || old == previous.obstacles_.end() || !sameShape(old->second, it->second)) {
+        ObstacleMessage obstacle = it->second;
+        obstacle.action = new_model && first ? am2b_iface::SET_SSV : am2b_iface::MODIFY_SSV;
+        batch->addObstacle(obstacle);
+      }
+    }
+  }
+
+  // Surfaces
+  for (auto const& entry : previous.surfaces_) {
+    if (surfaces_.find(entry.first) == surfaces_.end()) {
+      batch->addSurfaceRemoval(entry.first);
+    }
+  }
+  for (auto const& entry : surfaces_) {
+    Surface const& surface = entry.second;
+    auto const old = previous.surfaces_.find(entry.first);
+    if (old == previous.surfaces_.end()) {
+      batch->addSurface(am2b_iface::SET_SURFACE, entry.first, surface.record.normal,
+                        surface.vertices.data(), surface.vertices.size() / 3);
+    } else if (old->second.vertices != surface.vertices
+               || memcmp(old->second.record.normal, surface.record.normal, sizeof(surface.record.normal)) != 0) {
+      batch->addSurface(am2b_iface::MODIFY_SURFACE, entry.first, surface.record.normal,
+                        surface.vertices.data(), surface.vertices.size() / 3);
+    }
+  }
+  return batch;
+}
@@ -0,0 +1,71 @@
+#ifndef LOLA_VISION_STATE_H__
+#define LOLA_VISION_STATE_H__
+
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <vector>
+#include <iface_vision_msg.hpp>
+#include <iface_vision_batch.hpp>
+
+/**
+ * The obstacles and surfaces that a sequence of vision updates (batches or
+ * obstacle and surface messages) leaves the receiver with.
+ *
+ * Lets a `RobotService` bring a receiver up to date without replaying
+ * everything that was sent: the difference between two states (e.g. what
+ * the receiver has and what it should have) is again a batch of updates.
+ */
+class VisionState {
+public:
+  VisionState() : frame_(0), timestamp_(0) {}
+
+  /**
+   * Applies the updates of the batch.
+   */
+  void apply(am2b_iface::VisionBatch const& batch);
+  /**
+   * Applies the update if the message is an obstacle or surface message.
+   * Returns whether it was.
+   */
+  bool apply(am2b_iface::VisionMessage const& msg);
+  /**
+   * Forgets all obstacles and surfaces.
+   */
+  void clear();
+  bool empty() const { return obstacles_.empty() && surfaces_.empty(); }
+
+  /**
+   * The updates that turn the `previous` state into this one, as a batch of
+   * the latest frame. Against an empty state, this creates everything: the
+   * first part of each model with SET_SSV (which implicitly creates the
+   * model), the other parts with MODIFY_SSV.
+   */
+  boost::shared_ptr<am2b_iface::VisionBatch> diff(VisionState const& previous) const;
+
+private:
+  struct Surface {
+    am2b_iface::SurfaceRecord record;
+    std::vector<float> vertices;
+  };
+  typedef std::map<std::pair<uint32_t, uint32_t>, am2b_iface::ObstacleMessage> ObstacleMap;
+
+  void apply(am2b_iface::ObstacleMessage const& obstacle);
+  void apply(am2b_iface::SurfaceRecord const& surface, std::vector<float> const& vertices);
+  /**
+   * Whether there is any part of the given model.
+   */
+  static bool hasModel(ObstacleMap const& obstacles, uint32_t model_id);
+
+  /**
+   * The frame and timestamp of the latest update.
+   */
+  uint32_t frame_;
+  uint64_t timestamp_;
+  /**
+   * The current obstacle parts, by (model ID, part ID), and surfaces, by ID.
+   */
+  ObstacleMap obstacles_;
+  std::map<uint32_t, Surface> surfaces_;
+};
+
+#endif
@@ -251,6 +251,10 @@ namespace am2b_iface
 
   //! event for new communication system with lepp3
   const MsgId VISION_MESSAGE                =  __MSG_ID_DEF_GLOBAL(__DOM_WPATT,0x502);
+  //! negotiation of the vision protocol version with lepp3 (VisionHello)
+  const MsgId VISION_HELLO                  =  __MSG_ID_DEF_GLOBAL(__DOM_WPATT,0x503);
+  //! all vision updates of one frame (vision protocol v2, VisionBatchHeader + records)
+  const MsgId VISION_BATCH                  =  __MSG_ID_DEF_GLOBAL(__DOM_WPATT,0x504);
 
 
 
@@ -0,0 +1,336 @@
+#ifndef LOLA_VISION_BATCH_H__
+#define LOLA_VISION_BATCH_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <iface_sig_wpatt.hpp>
+#include <iface_vision_msg.hpp>
+
+/*
+ * Version 2 of the vision protocol.
+ *
+ * After connecting, the vision node sends a VISION_HELLO message with the
+ * highest protocol version it speaks, and the receiver answers with a
+ * VISION_HELLO carrying the version to use. Receivers that do not answer
+ * (in time) are spoken to with version 1, i.e. one VISION_MESSAGE per
+ * obstacle part and surface.
+ *
+ * With version 2, all obstacle and surface updates of a frame are sent as a
+ * single VISION_BATCH message: a `VisionBatchHeader` followed by `count`
+ * records, each a `VisionRecordHeader` followed by `len` bytes:
+ *
+ *  - Obstacle: an `ObstacleRecord` followed by `coeff_count` floats
+ *  - Surface:  a `SurfaceRecord` followed by `vertex_count` x, y, z floats
+ *
+ * Surface hulls have any number of vertices. A surface without vertices is
+ * known, but must not be used for planning. Point clouds and images are
+ * still sent as VISION_MESSAGEs.
+ */
+
+#pragma pack(push,1)
+
+namespace am2b_iface
+{
+    const uint32_t VISION_PROTOCOL_V1 = 1;
+    const uint32_t VISION_PROTOCOL_V2 = 2;
+
+    struct VisionHello {
+      uint32_t version;
+    };
+
+    struct VisionBatchHeader {
+      uint32_t frame;      // frame_id the information belongs to
+      uint64_t timestamp;  // capture time of the frame (us)
+      uint32_t count;      // number of records
+    };
+
+    struct VisionRecordHeader {
+      Message_Type type;   // Obstacle or Surface
+      uint32_t len;        // size of the record after this header
+    };
+
+    struct ObstacleRecord {
+      uint32_t action;     // add, remove, modify, ...
+      uint32_t model_id;
+      uint32_t part_id;
+      uint8_t type;        // ObstacleType
+      uint8_t coeff_count; // number of coefficients following the record
+      float radius;
+    };
+
+    struct SurfaceRecord {
+      uint32_t action;     // add, remove, modify, ...
+      uint32_t id;
+      float normal[3];
+      uint32_t vertex_count; // number of hull vertices following the record
+    };
+}
+
+#pragma pack(pop)
+
+namespace am2b_iface
+{
+    /**
+     * The contents of a VISION_BATCH message, built up record by record.
+     */
+    class VisionBatch {
+    public:
+      VisionBatch(uint32_t frame, uint64_t timestamp)
+        : data_(sizeof(VisionBatchHeader))
+      {
+        VisionBatchHeader header;
+        header.frame = frame;
+        header.timestamp = timestamp;
+        header.count = 0;
+        memcpy(data_.data(), &header, sizeof(header));
+      }
+
+      /**
+       * Adds an obstacle update. Only the coefficients that the type of the
+       * obstacle uses are sent; deletions carry none.
+       */
+      void addObstacle(ObstacleMessage const& msg)
+      {
+        ObstacleRecord record;
+        record.action = msg.action;
+        record.model_id = msg.model_id;
+        record.part_id = msg.part_id;
+        bool const removal = msg.action == REMOVE_SSV_WHOLE_SEGMENT || msg.action == REMOVE_SSV_ONLY_PART;
+        record.type = removal ? 0 : msg.type;
+        record.coeff_count = removal ? 0 : msg.type == Sphere ? 3 : msg.type == Capsule ? 6 : 9;
+        record.radius = removal ? 0 : msg.radius;
+
+        char* out = addRecord(Message_Type::Obstacle, record, record.coeff_count * sizeof(float));
+        memcpy(out, msg.coeffs, record.coeff_count * sizeof(float));
+      }
+
+      /**
+       * Adds a surface update with a hull of `vertex_count` vertices (x, y, z each).
+       */
+      void addSurface(uint32_t action, uint32_t id, const float normal[3],
+                      const float* vertices, uint32_t vertex_count)
+      {
+        SurfaceRecord record;
+        record.action = action;
+        record.id = id;
+        memcpy(record.normal, normal, sizeof(record.normal));
+        record.vertex_count = vertex_count;
+
+        char* out = addRecord(Message_Type::Surface, record, 3 * vertex_count * sizeof(float));
+        memcpy(out, vertices, 3 * vertex_count * sizeof(float));
+      }
+
+      /**
+       * Adds the removal of a surface.
+       */
+      void addSurfaceRemoval(uint32_t id)
+      {
+        float const normal[3] = { 0, 0, 0 };
+        addSurface(REMOVE_SURFACE, id, normal, nullptr, 0);
+      }
+
+      VisionBatchHeader header() const
+      {
+        VisionBatchHeader header;
+        memcpy(&header, data_.data(), sizeof(header));
+        return header;
+      }
+      bool empty() const { return header().count == 0; }
+
+      /**
+       * The message content, i.e. the batch header and all records.
+       */
+      const char* data() const { return data_.data(); }
+      uint32_t size() const { return data_.size(); }
+
+    private:
+      template<class Record>
+      char* addRecord(Message_Type type, Record const& record, size_t extra_len)
+      {
+        VisionRecordHeader record_header;
+        record_header.type = type;
+        record_header.len = sizeof(record) + extra_len;
+
+        size_t const offset = data_.size();
+        data_.resize(offset + sizeof(record_header) + record_header.len);
+        memcpy(&data_[offset], &record_header, sizeof(record_header));
+        memcpy(&data_[offset + sizeof(record_header)], &record, sizeof(record));
+
+        VisionBatchHeader header = this->header();
+        ++header.count;
+        memcpy(data_.data(), &header, sizeof(header));
+        return &data_[offset + sizeof(record_header) + sizeof(record)];
+      }
+
+      std::vector<char> data_;
+    };
+
+    /**
+     * Iterates over the records of a received VISION_BATCH message.
+     *
+     *   VisionBatchReader reader(data, len);
+     *   while (reader.next()) { switch (reader.type()) ... }
+     */
+    class VisionBatchReader {
+    public:
+      VisionBatchReader(const char* data, size_t len)
+        : data_(data), len_(len), offset_(0), record_(nullptr), record_len_(0), remaining_(0)
+      {
+        if (len_ >= sizeof(VisionBatchHeader))
+        {
+          memcpy(&header_, data_, sizeof(header_));
+          offset_ = sizeof(header_);
+          remaining_ = header_.count;
+        }
+      }
+
+      /**
+       * Whether the data holds a batch header and all of its records.
+       */
+      bool valid() const
+      {
+        if (len_ < sizeof(VisionBatchHeader))
+          return false;
+        VisionBatchReader reader(*this);
+        while (reader.next())
+          ;
+        return reader.remaining_ == 0 && reader.offset_ == len_;
+      }
+
+      VisionBatchHeader const& header() const { return header_; }
+
+      /**
+       * Advances to the next record. Returns false after the last record, or
+       * if the batch is truncated.
+       */
+      bool next()
+      {
+        if (remaining_ == 0 || len_ - offset_ < sizeof(VisionRecordHeader))
+          return false;
+        VisionRecordHeader record_header;
+        memcpy(&record_header, data_ + offset_, sizeof(record_header));
+        if (len_ - offset_ - sizeof(record_header) < record_header.len)
+          return false;
+
+        type_ = record_header.type;
+        record_ = data_ + offset_ + sizeof(record_header);
+        record_len_ = record_header.len;
+        offset_ += sizeof(record_header) + record_header.len;
+        --remaining_;
+        return true;
+      }
+
+      Message_Type type() const { return type_; }
+
+      /**
+       * Reads the current obstacle record into its version 1 representation.
+       */
+      bool read(ObstacleMessage& msg) const
+      {
+        ObstacleRecord record;
+        if (type_ != Message_Type::Obstacle || record_len_ < sizeof(record))
+          return false;
+        memcpy(&record, record_, sizeof(record));
+        if (record.coeff_count > 9 || record_len_ != sizeof(record) + record.coeff_count * sizeof(float))
+          return false;
+
+        msg.action = record.action;
+        msg.model_id = record.model_id;
+        msg.part_id = record.part_id;
+        msg.type = (ObstacleType)record.type;
+        msg.radius = record.radius;
+        msg.surface = -1;
+        memset(msg.coeffs, 0, sizeof msg.coeffs);
+        memcpy(msg.coeffs, record_ + sizeof(record), record.coeff_count * sizeof(float));
+        return true;
+      }
+
+      /**
+       * Reads the current surface record and its hull vertices (x, y, z each).
+       */
+      bool read(SurfaceRecord& surface, std::vector<float>& vertices) const
+      {
+        if (type_ != Message_Type::Surface || record_len_ < sizeof(surface))
+          return false;
+        memcpy(&surface, record_, sizeof(surface));
+        if (record_len_ != sizeof(surface) + 3 * surface.vertex_count * sizeof(float))
+          return false;
+
+        vertices.resize(3 * surface.vertex_count);
+        memcpy(vertices.data(), record_ + sizeof(surface), vertices.size() * sizeof(float));
+        return true;
+      }
+
+    private:
+      const char* data_;
+      size_t len_;
+      size_t offset_;
+      VisionBatchHeader header_;
+
+      Message_Type type_;
+      const char* record_;
+      uint32_t record_len_;
+      uint32_t remaining_;
+    };
+
+    /**
+     * Converts the records of a batch to version 1 messages, passing each of
+     * them to the callback.
+     *
+     * Version 1 surfaces have exactly 8 hull vertices: smaller hulls are filled
+     * up with their last vertex, larger ones are cut off. Surfaces that must
+     * not be used for planning get a tiny hull far away from the robot
+     * instead, so that the surface IDs stay consistent on both sides.
+     */
+    template<class Callback>
+    void toVisionMessages(VisionBatch const& batch, Callback callback)
+    {
+      VisionBatchReader reader(batch.data(), batch.size());
+      long const frame = reader.header().frame;
+      std::vector<float> vertices;
+      while (reader.next())
+      {
+        if (reader.type() == Message_Type::Obstacle)
+        {
+          ObstacleMessage msg;
+          if (reader.read(msg))
+            callback(VisionMessage(msg, frame));
+        }
+        else if (reader.type() == Message_Type::Surface)
+        {
+          SurfaceRecord record;
+          if (!reader.read(record, vertices))
+            continue;
+
+          SurfaceMessage msg;
+          memset(&msg, 0, sizeof(msg));
+          msg.id = record.id;
+          msg.action = record.action;
+          memcpy(msg.normal, record.normal, sizeof(msg.normal));
+          if (record.action != REMOVE_SURFACE)
+          {
+            if (record.vertex_count == 0)
+            {
+              vertices.resize(3 * 8);
+              for (size_t i = 0; i < 8; ++i)
+              {
+                vertices[3 * i] = -4.9f + std::sin((float)i) * 0.01f;
+                vertices[3 * i + 1] = -4.9f + std::cos((float)i) * 0.01f;
+                vertices[3 * i + 2] = -4.9f + i * 0.01f;
+              }
+            }
+            size_t const count = vertices.size() / 3;
+            for (size_t i = 0; i < 8; ++i)
+              memcpy(&msg.vertices[3 * i], &vertices[3 * std::min(i, count - 1)], 3 * sizeof(float));
+          }
+          callback(VisionMessage(msg, frame));
+        }
+      }
+    }
+}
+
+#endif // LOLA_VISION_BATCH_H__
@@ -0,0 +1,303 @@
+#ifndef LOLA_VISION_CLOUD_H__
+#define LOLA_VISION_CLOUD_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_set>
+#include <vector>
+
+#include <iface_vision_msg.hpp>
+
+/*
+ * Encoding of the compressed point clouds sent in `CompressedPointCloudMessage`s.
+ *
+ * The points are quantized to 16-bit fixed point coordinates relative to the
+ * minimum corner of the cloud (the origin of the message) and optionally
+ * decimated to one point per voxel. Along each axis, the differences between
+ * subsequent points are zigzag encoded and split into a plane of low bytes
+ * and a plane of high bytes, since neighboring points of a depth image are
+ * close to each other and the high bytes then mostly vanish. The planes
+ * (x low, x high, y low, ...) are finally compressed in the LZ4 block format.
+ */
+
+namespace am2b_iface
+{
+namespace cloud_codec
+{
+    namespace detail
+    {
+      const size_t MIN_MATCH = 4;
+      // no match may start within the last MF_LIMIT bytes and the last LAST_LITERALS bytes are always literals
+      const size_t MF_LIMIT = 12;
+      const size_t LAST_LITERALS = 5;
+      const size_t MAX_OFFSET = 65535;
+      const int HASH_BITS = 12;
+
+      inline uint32_t read32(const uint8_t* p)
+      {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+      }
+
+      inline void writeLength(std::vector<uint8_t>& out, size_t len)
+      {
+        for (; len >= 255; len -= 255)
+          out.push_back(255);
+        out.push_back(static_cast<uint8_t>(len));
+      }
+
+      inline void writeSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_len,
+                                size_t offset, size_t match_len)
+      {
+        size_t const match_code = match_len - MIN_MATCH;
+        out.push_back(static_cast<uint8_t>((std::min<size_t>(literal_len, 15) << 4) | std::min<size_t>(match_code, 15)));
+        if (literal_len >= 15)
+          writeLength(out, literal_len - 15);
+        out.insert(out.end(), literals, literals + literal_len);
+        out.push_back(static_cast<uint8_t>(offset & 0xff));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (match_code >= 15)
+          writeLength(out, match_code - 15);
+      }
+
+      inline bool readLength(const uint8_t* src, size_t len, size_t& ip, size_t& value)
+      {
+        uint8_t b;
+        do
+        {
+          if (ip >= len)
+            return false;
+          b = src[ip++];
+          value += b;
+        } while (b == 255);
+        return true;
+      }
+    }
+
+    /**
+     * Compresses the bytes into the LZ4 block format (greedy matching on a hash
+     * of the next four bytes), appending them to `out`.
+     */
+    inline void compress(const uint8_t* src, size_t len, std::vector<uint8_t>& out)
+    {
+      using namespace detail;
+      std::vector<uint32_t> table(1 << HASH_BITS, 0); // position + 1 of the last occurrence of each hash
+      size_t anchor = 0;
+
+      if (len > MF_LIMIT)
+      {
+        size_t const match_limit = len - MF_LIMIT;
+        size_t i = 0;
+        while (i < match_limit)
+        {
+          uint32_t const sequence = read32(src + i);
+          uint32_t const hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+          size_t const candidate = table[hash];
+          table[hash] = i + 1;
+
+          if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != sequence)
+          {
+            ++i;
+            continue;
+          }
+
+          size_t const ref = candidate - 1;
+          size_t match_len = MIN_MATCH;
+          while (i + match_len < len - LAST_LITERALS && src[ref + match_len] == src[i + match_len])
+            ++match_len;
+
+          writeSequence(out, src + anchor, i - anchor, i - ref, match_len);
+          i += match_len;
+          anchor = i;
+        }
+      }
+
+      // the remaining bytes are literals
+      size_t const literal_len = len - anchor;
+      out.push_back(static_cast<uint8_t>(std::min<size_t>(literal_len, 15) << 4));
+      if (literal_len >= 15)
+        writeLength(out, literal_len - 15);
+      out.insert(out.end(), src + anchor, src + len);
+    }
+
+    /**
+     * Decompresses an LZ4 block into exactly `dst_len` bytes. Returns false if
+     * the data is malformed.
+     */
+    inline bool decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+    {
+      using namespace detail;
+      size_t ip = 0;
+      size_t op = 0;
+      while (ip < len)
+      {
+        uint8_t const token = src[ip++];
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !readLength(src, len, ip, literal_len))
+          return false;
+        if (literal_len > len - ip || literal_len > dst_len - op)
+          return false;
+        if (literal_len > 0)
+          memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        // the last sequence has no match
+        if (ip == len)
+          break;
+
+        if (len - ip < 2)
+          return false;
+        size_t const offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+          return false;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !readLength(src, len, ip, match_len))
+          return false;
+        match_len += MIN_MATCH;
+        if (match_len > dst_len - op)
+          return false;
+        // byte by byte, since the match may overlap the output
+        for (size_t i = 0; i < match_len; ++i, ++op)
+          dst[op] = dst[op - offset];
+      }
+      return op == dst_len;
+    }
+
+    /**
+     * Encodes the finite points of a cloud, given as x, y, z floats with `stride`
+     * bytes between subsequent points, appending the compressed data to `out`.
+     *
+     * Coordinates are quantized with the given resolution (which is coarsened if
+     * the cloud would not fit into 16 bits otherwise). If `voxel_size` is
+     * positive, only the first point of each voxel is kept.
+     */
+    inline CompressedPointCloudMessage encode(const void* points, size_t count, size_t stride,
+                                              float resolution, float voxel_size, std::vector<uint8_t>& out)
+    {
+      const uint8_t* const base = static_cast<const uint8_t*>(points);
+      auto point = [base, stride](size_t i) { return reinterpret_cast<const float*>(base + i * stride); };
+
+      float min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+      float max[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+      std::vector<uint32_t> kept;
+      kept.reserve(count);
+      for (size_t i = 0; i < count; ++i)
+      {
+        const float* p = point(i);
+        if (!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2]))
+          continue;
+        kept.push_back(i);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          min[axis] = std::min(min[axis], p[axis]);
+          max[axis] = std::max(max[axis], p[axis]);
+        }
+      }
+
+      CompressedPointCloudMessage msg;
+      msg.count = 0;
+      msg.raw_len = 0;
+      msg.resolution = resolution;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        msg.origin[axis] = kept.empty() ? 0 : min[axis];
+        if (!kept.empty())
+          msg.resolution = std::max(msg.resolution, (max[axis] - min[axis]) / 65535.f);
+      }
+
+      if (voxel_size > 0)
+      {
+        std::unordered_set<uint64_t> voxels;
+        voxels.reserve(kept.size());
+        size_t n = 0;
+        for (size_t k = 0; k < kept.size(); ++k)
+        {
+          const float* p = point(kept[k]);
+          uint64_t key = 0;
+          for (int axis = 0; axis < 3; ++axis)
+            key = (key << 21) | (static_cast<uint64_t>((p[axis] - msg.origin[axis]) / voxel_size) & ((1 << 21) - 1));
+          if (voxels.insert(key).second)
+            kept[n++] = kept[k];
+        }
+        kept.resize(n);
+      }
+
+      // zigzag encoded deltas, as planes of low and high bytes per axis
+      size_t const n = kept.size();
+      std::vector<uint8_t> raw(6 * n);
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        uint8_t* const low = &raw[2 * axis * n];
+        uint8_t* const high = low + n;
+        uint16_t previous = 0;
+        for (size_t k = 0; k < n; ++k)
+        {
+          float const offset = (point(kept[k])[axis] - msg.origin[axis]) / msg.resolution;
+          uint16_t const q = static_cast<uint16_t>(std::min(std::lround(offset), 65535l));
+          int16_t const delta = static_cast<int16_t>(q - previous);
+          uint16_t const zigzag = static_cast<uint16_t>((static_cast<uint16_t>(delta) << 1) ^ (delta >> 15));
+          low[k] = zigzag & 0xff;
+          high[k] = zigzag >> 8;
+          previous = q;
+        }
+      }
+
+      msg.count = n;
+      msg.raw_len = raw.size();
+      compress(raw.data(), raw.size(), out);
+      return msg;
+    }
+
+    /**
+     * Decodes the compressed data of the message into x, y, z floats (3 per
+     * point). Returns false if the data is malformed.
+     */
+    inline bool decode(const CompressedPointCloudMessage& msg, const uint8_t* data, size_t len, std::vector<float>& xyz)
+    {
+      size_t const n = msg.count;
+      if (msg.raw_len != 6 * n)
+        return false;
+      std::vector<uint8_t> raw(msg.raw_len);
+      if (!decompress(data, len, raw.data(), raw.size()))
+        return false;
+
+      xyz.resize(3 * n);
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        const uint8_t* const low = &raw[2 * axis * n];
+        const uint8_t* const high = low + n;
+        uint16_t q = 0;
+        for (size_t k = 0; k < n; ++k)
+        {
+          uint16_t const zigzag = low[k] | (high[k] << 8);
+          int16_t const delta = static_cast<int16_t>((zigzag >> 1) ^ -(zigzag & 1));
+          q = static_cast<uint16_t>(q + delta);
+          xyz[3 * k + axis] = msg.origin[axis] + q * msg.resolution;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Decodes the content of a received message (the message followed by the
+     * compressed data) of `len` bytes. Returns false if it is truncated or
+     * malformed.
+     */
+    inline bool decode(const char* content, size_t len, CompressedPointCloudMessage& msg, std::vector<float>& xyz)
+    {
+      if (len < sizeof(CompressedPointCloudMessage))
+        return false;
+      memcpy(&msg, content, sizeof(msg));
+      return decode(msg, (const uint8_t*)content + sizeof(msg), len - sizeof(msg), xyz);
+    }
+}
+}
+
+#endif // LOLA_VISION_CLOUD_H__
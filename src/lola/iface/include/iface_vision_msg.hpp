@@ -3,6 +3,7 @@
 
 #include <string.h>
 #include <iface_sig_wpatt.hpp>
+#include <memory>
 #include <vector>
 #include <iostream>
 
@@ -16,7 +17,8 @@ namespace am2b_iface
       Obstacle = 0,
       Surface,
       RGB_Image,
-      PointCloud
+      PointCloud,
+      CompressedPointCloud
     };
 
     enum ObstacleType
@@ -406,6 +408,28 @@ namespace am2b_iface
         data = new unsigned char[numpoints*pointsize];
         memcpy(data, pt_data, numpoints*pointsize);
       }
+
+      /**
+       * Creates the message without a copy of the points, to be sent with a
+       * VisionMessage that references the points instead.
+       */
+      PointCloudMessage(uint32_t numpoints, uint32_t pointsize)
+      {
+        format = pointsize;
+        count = numpoints;
+        data = nullptr;
+      }
+    };
+
+    /**
+     * A point cloud with quantized coordinates, followed by the compressed
+     * points (see iface_vision_cloud.hpp for the encoding).
+     */
+    struct CompressedPointCloudMessage {
+      uint32_t count;     // number of points
+      uint32_t raw_len;   // size of the points before compression
+      float origin[3];    // coordinates of the point (0, 0, 0)
+      float resolution;   // size of a coordinate step
     };
 
     /**
@@ -437,6 +461,11 @@ namespace am2b_iface
             out << "PointCloud";
             break;
           }
+          case Message_Type::CompressedPointCloud:
+          {
+            out << "Compressed PointCloud";
+            break;
+          }
           case Message_Type::RGB_Image:
           {
             out << "RGB Image";
@@ -452,6 +481,12 @@ namespace am2b_iface
         return out;
       }
     };
+}
+
+#pragma pack(pop)
+
+namespace am2b_iface
+{
 
     /**
      * A struct representing the raw vision message format that is sent to the
@@ -461,10 +496,17 @@ namespace am2b_iface
       /*
         When VisionMessages are sent over the network, only the header and the data pointed
         to by content are sent. We don't send the whole VisionMessage struct (which includes
-        a pointer that would not be useful on the other side).
+        a pointer that would not be useful on the other side), which is why it is not packed.
+
+        Large data (point clouds, images) is not copied into content: content only holds the
+        message struct, and payload references the data, which follows the content on the wire
+        (header.len covers both). The payload is shared by all copies of the message and keeps
+        the data alive.
        */
       VisionMessageHeader header;
       char* content = nullptr;
+      std::shared_ptr<const void> payload;
+      uint32_t payload_len = 0;
 
       VisionMessage(const ObstacleMessage& msg, long frame_num)
       {
@@ -504,6 +546,13 @@ namespace am2b_iface
         memcpy(content + sizeof(msg), msg.data, msg.format * msg.count);
       }
 
+      /**
+       * Creates a point cloud message that references the points instead of copying them.
+       */
+      VisionMessage(const PointCloudMessage& msg, long frame_num, std::shared_ptr<const void> points)
+        : VisionMessage(msg, Message_Type::PointCloud, msg.format * msg.count, frame_num, std::move(points))
+      {}
+
       VisionMessage(const RGBMessage& msg, long frame_num)
       {
         header.type = Message_Type::RGB_Image;
@@ -516,11 +565,37 @@ namespace am2b_iface
         memcpy(content + sizeof(msg), msg.pixels, 3 * msg.height * msg.width);
       }
 
+      /**
+       * Creates a compressed point cloud message that references the compressed points.
+       */
+      VisionMessage(const CompressedPointCloudMessage& msg, long frame_num,
+                    std::shared_ptr<const void> data, uint32_t data_len)
+        : VisionMessage(msg, Message_Type::CompressedPointCloud, data_len, frame_num, std::move(data))
+      {}
+
+      /**
+       * Creates an image message that references the pixels instead of copying them.
+       */
+      VisionMessage(const RGBMessage& msg, long frame_num, std::shared_ptr<const void> pixels)
+        : VisionMessage(msg, Message_Type::RGB_Image, 3 * msg.height * msg.width, frame_num, std::move(pixels))
+      {}
+
       // copy constructor
-      VisionMessage(const VisionMessage& msg) : header(msg.header)
+      VisionMessage(const VisionMessage& msg)
+        : header(msg.header), payload(msg.payload), payload_len(msg.payload_len)
       {
-        content = new char[header.len];
-        memcpy(content, msg.content, header.len);
+        content = new char[contentLength()];
+        memcpy(content, msg.content, contentLength());
+      }
+
+      VisionMessage& operator=(const VisionMessage&) = delete;
+
+      /**
+       * The number of bytes of the content, i.e. the message without the payload.
+       */
+      uint32_t contentLength() const
+      {
+        return header.len - payload_len;
       }
 
       ~VisionMessage()
@@ -532,6 +607,20 @@ namespace am2b_iface
         }
       }
 
+    private:
+      template<class Message>
+      VisionMessage(const Message& msg, Message_Type type, uint32_t data_len, long frame_num,
+                    std::shared_ptr<const void> data)
+        : payload(std::move(data)), payload_len(data_len)
+      {
+        header.type = type;
+        header.len = sizeof(msg) + data_len;
+        header.frame = frame_num;
+        content = new char[sizeof(msg)];
+        memcpy(content, &msg, sizeof(msg));
+      }
+
+    public:
       // << overload to make printing message details easier
       friend std::ostream& operator<<(std::ostream& out, VisionMessage const& msg)
       {
@@ -556,6 +645,11 @@ namespace am2b_iface
             out << "PointCloud";
             break;
           }
+          case Message_Type::CompressedPointCloud:
+          {
+            out << "Compressed PointCloud";
+            break;
+          }
           case Message_Type::RGB_Image:
           {
             out << "RGB Image";
@@ -574,6 +668,4 @@ namespace am2b_iface
     };
 }
 
-#pragma pack(pop)
-
 #endif // LOLA_VISION_MESSAGE_H__
@@ -0,0 +1,416 @@
+#ifndef LOLA_VISION_SHM_H__
+#define LOLA_VISION_SHM_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+ * Handing vision messages to consumers on the same machine through POSIX
+ * shared memory.
+ *
+ * The shared memory object holds a `VisionShmHeader` followed by a ring
+ * buffer of `capacity` bytes (a power of two). A single writer appends
+ * messages (an am2b_iface::MsgHeader followed by its content, exactly as on
+ * the TCP stream), each preceded by a `VisionShmRecord` and padded to 8
+ * bytes. Any number of readers follow the writer, each with its own read
+ * position; the writer never waits for them.
+ *
+ * `head` is the position after the last complete message and `reserved` the
+ * position after the message being written (positions only ever grow, the
+ * offset in the ring is the position modulo the capacity). The writer
+ * announces `reserved` before overwriting anything, so a reader that copied a
+ * message can tell whether it was overwritten meanwhile, like a seqlock.
+ * Readers that fell behind by more than the capacity lose messages, which
+ * they notice by the record sequence numbers.
+ *
+ * Readers start with the next message written after they opened the object,
+ * so the writer periodically writes a keyframe: a batch that creates all of
+ * the current obstacles and surfaces, marked by `VISION_SHM_KEYFRAME` in its
+ * record. Readers that started late or lost messages replace their state
+ * with the next keyframe.
+ */
+
+namespace am2b_iface
+{
+    const uint32_t VISION_SHM_MAGIC = 0x4d485356; // "VSHM"
+    const uint32_t VISION_SHM_VERSION = 2;
+    // record flag: the message holds the complete current state
+    const uint32_t VISION_SHM_KEYFRAME = 1;
+
+    struct VisionShmHeader {
+      std::atomic<uint32_t> magic;  // set once the buffer is initialized
+      uint32_t version;
+      uint64_t capacity;            // size of the ring buffer (bytes)
+      alignas(64) std::atomic<uint64_t> head;
+      alignas(64) std::atomic<uint64_t> reserved;
+      // wake-ups of waiting readers
+      alignas(64) std::atomic<uint32_t> notify;
+      std::atomic<uint32_t> waiters;
+    };
+
+    struct VisionShmRecord {
+      uint32_t len;       // size of the message following the record
+      uint32_t sequence;  // number of the message
+      uint32_t flags;     // VISION_SHM_KEYFRAME
+      uint64_t time;      // when the message was written (CLOCK_MONOTONIC, ns)
+    };
+
+    namespace shm_detail
+    {
+      inline uint64_t now()
+      {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+      }
+
+      inline uint64_t padded(uint64_t len)
+      {
+        return (len + 7) & ~uint64_t(7);
+      }
+
+      inline size_t mappingSize(uint64_t capacity)
+      {
+        return sizeof(VisionShmHeader) + capacity;
+      }
+
+      inline char* ring(VisionShmHeader* header)
+      {
+        return reinterpret_cast<char*>(header) + sizeof(VisionShmHeader);
+      }
+
+      inline void wake(VisionShmHeader* header)
+      {
+        header->notify.fetch_add(1);
+        if (header->waiters.load() == 0)
+          return;
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->notify), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+      }
+
+      /**
+       * Waits until `notify` differs from `value`, at most `timeout_us`.
+       */
+      inline void wait(VisionShmHeader* header, uint32_t value, uint64_t timeout_us)
+      {
+#ifdef __linux__
+        timespec timeout;
+        timeout.tv_sec = timeout_us / 1000000;
+        timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->notify), FUTEX_WAIT, value, &timeout, nullptr, 0);
+#else
+        (void)header; (void)value;
+        usleep(std::min<uint64_t>(timeout_us, 100));
+#endif
+      }
+    }
+
+    /**
+     * Creates the shared memory object and writes messages into it. Only one
+     * writer may exist per object.
+     */
+    class VisionShmWriter {
+    public:
+      VisionShmWriter() : header_(nullptr), size_(0), head_(0), sequence_(0) {}
+      ~VisionShmWriter() { close(); }
+
+      /**
+       * Creates (or replaces) the shared memory object with the given name,
+       * e.g. "/lepp3_vision", with a ring buffer of at least `capacity` bytes.
+       * Returns false and leaves errno set if that fails.
+       */
+      bool create(std::string const& name, uint64_t capacity)
+      {
+        close();
+        uint64_t ring_capacity = 4096;
+        while (ring_capacity < capacity)
+          ring_capacity *= 2;
+
+        // readers still attached to an old object keep it, but see no more messages
+        shm_unlink(name.c_str());
+        int const fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd == -1)
+          return false;
+        size_t const size = shm_detail::mappingSize(ring_capacity);
+        void* mem = ftruncate(fd, size) == 0
+          ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+          : MAP_FAILED;
+        int const error = errno;
+        ::close(fd);
+        if (mem == MAP_FAILED)
+        {
+          shm_unlink(name.c_str());
+          errno = error;
+          return false;
+        }
+
+        name_ = name;
+        size_ = size;
+        header_ = static_cast<VisionShmHeader*>(mem);
+        header_->version = VISION_SHM_VERSION;
+        header_->capacity = ring_capacity;
+        header_->head.store(0);
+        header_->reserved.store(0);
+        header_->notify.store(0);
+        header_->waiters.store(0);
+        header_->magic.store(VISION_SHM_MAGIC, std::memory_order_release);
+        head_ = 0;
+        sequence_ = 0;
+        return true;
+      }
+
+      /**
+       * Unmaps and removes the shared memory object.
+       */
+      void close()
+      {
+        if (!header_)
+          return;
+        munmap(header_, size_);
+        shm_unlink(name_.c_str());
+        header_ = nullptr;
+      }
+
+      /**
+       * Appends a message, gathered from the given parts, with the given
+       * record flags. Returns false if the message does not fit into the
+       * buffer.
+       */
+      bool write(const iovec* parts, int count, uint32_t flags = 0)
+      {
+        size_t len = 0;
+        for (int i = 0; i < count; ++i)
+          len += parts[i].iov_len;
+        uint64_t const capacity = header_->capacity;
+        uint64_t const size = shm_detail::padded(sizeof(VisionShmRecord) + len);
+        if (size > capacity / 2)
+          return false;
+
+        VisionShmRecord record;
+        record.len = len;
+        record.sequence = sequence_++;
+        record.flags = flags;
+        record.time = shm_detail::now();
+
+        header_->reserved.store(head_ + size, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        uint64_t position = copyIn(head_, &record, sizeof(record));
+        for (int i = 0; i < count; ++i)
+          position = copyIn(position, parts[i].iov_base, parts[i].iov_len);
+        head_ += size;
+        header_->head.store(head_, std::memory_order_release);
+        shm_detail::wake(header_);
+        return true;
+      }
+
+      uint64_t capacity() const { return header_ ? header_->capacity : 0; }
+
+    private:
+      uint64_t copyIn(uint64_t position, const void* data, size_t len)
+      {
+        uint64_t const capacity = header_->capacity;
+        size_t const offset = position & (capacity - 1);
+        size_t const first = std::min<uint64_t>(len, capacity - offset);
+        char* const ring = shm_detail::ring(header_);
+        memcpy(ring + offset, data, first);
+        memcpy(ring, static_cast<const char*>(data) + first, len - first);
+        return position + len;
+      }
+
+      std::string name_;
+      VisionShmHeader* header_;
+      size_t size_;
+      uint64_t head_;
+      uint32_t sequence_;
+    };
+
+    /**
+     * Reads the messages from a shared memory object created by a
+     * `VisionShmWriter`, starting with the next message written after opening.
+     */
+    class VisionShmReader {
+    public:
+      VisionShmReader()
+        : device_(0), inode_(0), header_(nullptr), size_(0), position_(0), started_(false), sequence_(0), flags_(0), latency_(0), lost_(0)
+      {}
+      ~VisionShmReader() { close(); }
+
+      /**
+       * Opens the shared memory object with the given name. Returns false if
+       * it does not exist (yet) or is not a vision message buffer.
+       */
+      bool open(std::string const& name)
+      {
+        close();
+        int const fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd == -1)
+          return false;
+        struct stat st;
+        void* mem = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(VisionShmHeader)
+          ? mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+          : MAP_FAILED;
+        ::close(fd);
+        if (mem == MAP_FAILED)
+          return false;
+
+        VisionShmHeader* header = static_cast<VisionShmHeader*>(mem);
+        if (header->magic.load(std::memory_order_acquire) != VISION_SHM_MAGIC
+            || header->version != VISION_SHM_VERSION
+            || shm_detail::mappingSize(header->capacity) != (size_t)st.st_size)
+        {
+          munmap(mem, st.st_size);
+          return false;
+        }
+
+        name_ = name;
+        device_ = st.st_dev;
+        inode_ = st.st_ino;
+        header_ = header;
+        size_ = st.st_size;
+        position_ = header_->head.load(std::memory_order_acquire);
+        started_ = false;
+        lost_ = 0;
+        return true;
+      }
+
+      void close()
+      {
+        if (!header_)
+          return;
+        munmap(header_, size_);
+        header_ = nullptr;
+      }
+
+      /**
+       * Whether the writer created a new shared memory object in place of the
+       * opened one, e.g. because it was restarted. Messages are only written
+       * to the new one, which needs to be opened.
+       */
+      bool replaced() const
+      {
+        int const fd = shm_open(name_.c_str(), O_RDONLY, 0);
+        if (fd == -1)
+          return false;
+        struct stat st;
+        bool const same = fstat(fd, &st) == 0 && st.st_dev == device_ && st.st_ino == inode_;
+        ::close(fd);
+        return !same;
+      }
+
+      /**
+       * Copies the next message into `message`, waiting at most `timeout_ms`
+       * for it. Returns false if there was none.
+       */
+      bool read(std::vector<char>& message, int timeout_ms)
+      {
+        uint64_t const capacity = header_->capacity;
+        uint64_t const deadline = shm_detail::now() + timeout_ms * 1000000ull;
+        while (true)
+        {
+          uint64_t const head = header_->head.load(std::memory_order_acquire);
+          if (head == position_)
+          {
+            uint64_t const now = shm_detail::now();
+            if (now >= deadline)
+              return false;
+            header_->waiters.fetch_add(1);
+            uint32_t const notify = header_->notify.load();
+            if (header_->head.load() == position_)
+              shm_detail::wait(header_, notify, (deadline - now) / 1000);
+            header_->waiters.fetch_sub(1);
+            continue;
+          }
+          if (head - position_ > capacity)
+          {
+            // overrun: skip to the latest message
+            position_ = head;
+            continue;
+          }
+
+          VisionShmRecord record;
+          copyOut(position_, &record, sizeof(record));
+          bool const plausible = record.len <= capacity / 2;
+          if (plausible)
+          {
+            message.resize(record.len);
+            copyOut(position_ + sizeof(record), message.data(), record.len);
+          }
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if (!plausible || header_->reserved.load(std::memory_order_relaxed) - position_ > capacity)
+          {
+            // overwritten while copying
+            position_ = header_->head.load(std::memory_order_acquire);
+            continue;
+          }
+
+          position_ += shm_detail::padded(sizeof(record) + record.len);
+          if (started_)
+            lost_ += record.sequence - sequence_ - 1;
+          started_ = true;
+          sequence_ = record.sequence;
+          flags_ = record.flags;
+          latency_ = shm_detail::now() - record.time;
+          return true;
+        }
+      }
+
+      /**
+       * The number of the message read last.
+       */
+      uint32_t sequence() const { return sequence_; }
+      /**
+       * Whether the message read last is a keyframe.
+       */
+      bool keyframe() const { return (flags_ & VISION_SHM_KEYFRAME) != 0; }
+      /**
+       * The time from writing the message read last until reading it (ns).
+       */
+      uint64_t latency() const { return latency_; }
+      /**
+       * The number of messages that were overwritten before they could be read.
+       */
+      uint32_t lost() const { return lost_; }
+
+    private:
+      void copyOut(uint64_t position, void* data, size_t len) const
+      {
+        uint64_t const capacity = header_->capacity;
+        size_t const offset = position & (capacity - 1);
+        size_t const first = std::min<uint64_t>(len, capacity - offset);
+        const char* const ring = shm_detail::ring(header_);
+        memcpy(data, ring + offset, first);
+        memcpy(static_cast<char*>(data) + first, ring, len - first);
+      }
+
+      std::string name_;
+      dev_t device_;
+      ino_t inode_;
+      VisionShmHeader* header_;
+      size_t size_;
+      uint64_t position_;
+      bool started_;
+      uint32_t sequence_;
+      uint32_t flags_;
+      uint64_t latency_;
+      uint32_t lost_;
+    };
+}
+
+#endif // LOLA_VISION_SHM_H__
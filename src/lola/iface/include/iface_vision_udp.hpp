@@ -0,0 +1,122 @@
+#ifndef LOLA_VISION_UDP_H__
+#define LOLA_VISION_UDP_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+/*
+ * Publishing of vision messages over UDP (unicast or multicast).
+ *
+ * Every message (an am2b_iface::MsgHeader followed by its content, exactly as
+ * on the TCP stream) is split into datagrams, each starting with a
+ * `VisionDatagramHeader`. Messages are numbered consecutively, so receivers
+ * can detect lost messages.
+ *
+ * Obstacles and surfaces are published as VISION_BATCHes (protocol version 2)
+ * that only contain the changes. Periodically, a keyframe is published: a
+ * batch that holds the complete current state (creating all obstacle parts
+ * and surfaces). Receivers that joined late or lost a message start over
+ * with the next keyframe.
+ */
+
+#pragma pack(push,1)
+
+namespace am2b_iface
+{
+    const uint32_t VISION_DATAGRAM_MAGIC = 0x32534956; // "VIS2"
+    /**
+     * Flag of the datagrams of a keyframe batch.
+     */
+    const uint32_t VISION_DATAGRAM_KEYFRAME = 1;
+
+    struct VisionDatagramHeader {
+      uint32_t magic;
+      uint32_t sequence;  // number of the message
+      uint32_t length;    // size of the whole message
+      uint32_t offset;    // offset of this fragment within the message
+      uint32_t flags;
+    };
+}
+
+#pragma pack(pop)
+
+namespace am2b_iface
+{
+    /**
+     * Reassembles the messages from received datagrams.
+     */
+    class VisionDatagramAssembler {
+    public:
+      VisionDatagramAssembler()
+        : started_(false), complete_(false), sequence_(0), flags_(0), received_(0), lost_(0)
+      {}
+
+      /**
+       * Adds a received datagram. Returns true if it completed a message,
+       * which is then available from `message()` until the next call.
+       *
+       * Datagrams of older messages and duplicate fragments are ignored; a
+       * newer message drops an incomplete one.
+       */
+      bool add(const char* data, size_t len)
+      {
+        VisionDatagramHeader header;
+        if (len < sizeof(header))
+          return false;
+        memcpy(&header, data, sizeof(header));
+        size_t const fragment_len = len - sizeof(header);
+        if (header.magic != VISION_DATAGRAM_MAGIC || header.offset > header.length
+            || fragment_len > header.length - header.offset)
+          return false;
+
+        if (!started_ || static_cast<int32_t>(header.sequence - sequence_) > 0)
+        {
+          // a new message; count the messages in between as lost, including
+          // an incomplete current one
+          if (started_)
+            lost_ += header.sequence - sequence_ - (complete_ ? 1 : 0);
+          started_ = true;
+          complete_ = false;
+          sequence_ = header.sequence;
+          flags_ = header.flags;
+          message_.resize(header.length);
+          received_ = 0;
+          offsets_.clear();
+        }
+        else if (header.sequence != sequence_ || complete_ || header.length != message_.size()
+                 || std::find(offsets_.begin(), offsets_.end(), header.offset) != offsets_.end())
+        {
+          return false;
+        }
+
+        offsets_.push_back(header.offset);
+        memcpy(message_.data() + header.offset, data + sizeof(header), fragment_len);
+        received_ += fragment_len;
+        complete_ = received_ >= message_.size();
+        return complete_;
+      }
+
+      std::vector<char> const& message() const { return message_; }
+      uint32_t sequence() const { return sequence_; }
+      bool keyframe() const { return (flags_ & VISION_DATAGRAM_KEYFRAME) != 0; }
+      /**
+       * The number of messages that were lost so far.
+       */
+      uint32_t lost() const { return lost_; }
+
+    private:
+      bool started_;
+      bool complete_;
+      uint32_t sequence_;
+      uint32_t flags_;
+      std::vector<char> message_;
+      size_t received_;
+      // offsets of the fragments of the current message received so far
+      std::vector<uint32_t> offsets_;
+      uint32_t lost_;
+    };
+}
+
+#endif // LOLA_VISION_UDP_H__
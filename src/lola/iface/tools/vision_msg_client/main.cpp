@@ -13,6 +13,7 @@
 #include <tclap/CmdLine.h>
 #include <iface_msg.hpp>
 #include <iface_vision_msg.hpp>
+#include <iface_vision_batch.hpp>
 
 using am2b_iface::VisionMessageHeader;
 using am2b_iface::Message_Type;
@@ -20,6 +21,7 @@ using am2b_iface::VisionMessage;
 using am2b_iface::ObstacleMessage;
 using am2b_iface::ObstacleType;
 using am2b_iface::SurfaceMessage;
+using am2b_iface::VisionBatch;
 
 
 
@@ -28,6 +30,8 @@ using am2b_iface::SurfaceMessage;
  *
  * This client will connect to a server at a given address and port,
  * and once connected will begin sending VisionMessages are regular intervals.
+ * It negotiates the protocol version first: with version 2 the updates of a
+ * frame are sent as one batch, with version 1 as separate messages.
  *
  * This can be used to verify if data is being received correctly, or as a reference
  * when implementing other components which need to receive VisionMessage data.
@@ -42,6 +46,7 @@ struct ParsedParams
 {
   unsigned int port = 0; // port to use
   std::string host_ip;   // server ip to connect to
+  unsigned int protocol = am2b_iface::VISION_PROTOCOL_V2; // highest protocol version to offer
   bool verbose = false;
 };
 
@@ -53,8 +58,11 @@ bool parse_args(int argc, char* argv[], ParsedParams* params)
     TCLAP::ValueArg<unsigned int> portArg("p","port","Port to send data on",true,0,"unsigned int");
     TCLAP::ValueArg<std::string>  hostArg("n","host","Hostname to connect to",true,"localhost","string");
 
+    TCLAP::ValueArg<unsigned int> protocolArg("","protocol","Highest vision protocol version to offer (default 2)",false,am2b_iface::VISION_PROTOCOL_V2,"unsigned int");
+
     cmd.add( portArg );
     cmd.add( hostArg );
+    cmd.add( protocolArg );
 
     TCLAP::SwitchArg verboseSwitch("v","verbose","Verbose output", cmd, false);
 
@@ -64,6 +72,7 @@ bool parse_args(int argc, char* argv[], ParsedParams* params)
     // Get the value parsed by each arg.
     params->port = portArg.getValue();
     params->host_ip = hostArg.getValue();
+    params->protocol = protocolArg.getValue();
     params->verbose = verboseSwitch.getValue();
     } catch (TCLAP::ArgException &e)  // catch any exceptions
     {
@@ -151,8 +160,67 @@ int connect(unsigned int port, std::string hostname, bool verbose)
   return s;
 }
 
+// sends the whole buffer to the given socket, s
+void sendAll(int s, const char* data, size_t len, const char* what, bool verbose)
+{
+  size_t total = 0;
+  while (total < len)
+  {
+    int sent = socket_send(s, (char*)data + total, len - total);
+    if (sent <= 0)
+      failWithError(std::string("Failed to send ") + what + "!");
+    total += sent;
+  }
+
+  if (verbose)
+  {
+    std::cout << "Sent " << total << " bytes (" << what << ")" << std::endl;
+  }
+}
+
+// offers the protocol version to the server, returns the version to use
+uint32_t negotiate(int s, unsigned int protocol, bool verbose)
+{
+  if (protocol <= am2b_iface::VISION_PROTOCOL_V1)
+    return am2b_iface::VISION_PROTOCOL_V1;
+
+#pragma pack(push,1)
+  struct
+  {
+    am2b_iface::MsgHeader header;
+    am2b_iface::VisionHello hello;
+  } offer, answer;
+#pragma pack(pop)
+  offer.header.id = am2b_iface::VISION_HELLO;
+  offer.header.len = sizeof(am2b_iface::VisionHello);
+  offer.hello.version = protocol;
+  sendAll(s, (char*)&offer, sizeof(offer), "hello", verbose);
+
+  // servers that don't know about the negotiation never answer
+  size_t received = 0;
+  while (received < sizeof(answer))
+  {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(s, &fds);
+    timeval timeout = { 1, 0 };
+    if (select(s + 1, &fds, NULL, NULL, &timeout) <= 0)
+      break;
+    int recvd = socket_recv(s, (char*)&answer + received, sizeof(answer) - received);
+    if (recvd <= 0)
+      break;
+    received += recvd;
+  }
+
+  uint32_t version = am2b_iface::VISION_PROTOCOL_V1;
+  if (received == sizeof(answer) && answer.header.id == am2b_iface::VISION_HELLO)
+    version = std::max(am2b_iface::VISION_PROTOCOL_V1, std::min<uint32_t>(protocol, answer.hello.version));
+  std::cout << "Using vision protocol version " << version << std::endl;
+  return version;
+}
+
 // sends data to the given socket, s
-void transmit(int s, bool verbose)
+void transmit(int s, uint32_t protocol, bool verbose)
 {
 #ifndef _WIN32
   // ignore SIGPIPE so we can print errors on write fails
@@ -162,78 +230,72 @@ void transmit(int s, bool verbose)
   // obstacles to send
   std::vector<double> sphere_coeffs  = {2.0, 2.0, 0.0,  0.0,  0.0,  0.0, 0.0, 0.0, 0.0};
   std::vector<double> capsule_coeffs = {1.0, 1.0, 1.0, -1.0, -1.0, -1.0, 0.0, 0.0, 0.0};
-  std::vector<VisionMessage> messages = {
-    VisionMessage(ObstacleMessage::SetMessage(ObstacleType::Sphere, 0, 1, 0.1, sphere_coeffs), 1),
-    VisionMessage(ObstacleMessage::SetMessage(ObstacleType::Capsule, 1, 1, 0.15, capsule_coeffs), 1),
-    VisionMessage(ObstacleMessage::ModifyMessage(ObstacleType::Sphere, 0, 1, 0.2, sphere_coeffs), 2),
-    VisionMessage(ObstacleMessage::ModifyMessage(ObstacleType::Capsule, 1, 1, 0.05, capsule_coeffs), 2),    
-    VisionMessage(ObstacleMessage::ModifyMessage(ObstacleType::Sphere, 0, 2, 0.2, sphere_coeffs), 3),
-    VisionMessage(ObstacleMessage::ModifyMessage(ObstacleType::Capsule, 1, 2, 0.05, capsule_coeffs), 3),
-    VisionMessage(ObstacleMessage::DeletePartMessage(0,2), 4),
-    VisionMessage(ObstacleMessage::DeletePartMessage(1,2), 4),
-    VisionMessage(ObstacleMessage::DeleteMessage(0), 5),
-    VisionMessage(ObstacleMessage::DeleteMessage(1), 5)
+  std::vector<std::pair<uint32_t, ObstacleMessage> > obstacles = {
+    { 1, ObstacleMessage::SetMessage(ObstacleType::Sphere, 0, 1, 0.1, sphere_coeffs) },
+    { 1, ObstacleMessage::SetMessage(ObstacleType::Capsule, 1, 1, 0.15, capsule_coeffs) },
+    { 2, ObstacleMessage::ModifyMessage(ObstacleType::Sphere, 0, 1, 0.2, sphere_coeffs) },
+    { 2, ObstacleMessage::ModifyMessage(ObstacleType::Capsule, 1, 1, 0.05, capsule_coeffs) },
+    { 3, ObstacleMessage::ModifyMessage(ObstacleType::Sphere, 0, 2, 0.2, sphere_coeffs) },
+    { 3, ObstacleMessage::ModifyMessage(ObstacleType::Capsule, 1, 2, 0.05, capsule_coeffs) },
+    { 4, ObstacleMessage::DeletePartMessage(0,2) },
+    { 4, ObstacleMessage::DeletePartMessage(1,2) },
+    { 5, ObstacleMessage::DeleteMessage(0) },
+    { 5, ObstacleMessage::DeleteMessage(1) }
   };
-
-  // NOTE: as long as we're only sending obstacles we can use the same iface header for all of them...
-  //       But if we update this to also send surfaces, we will need different headers due to different message sizes
-  am2b_iface::MsgHeader iface_header = { am2b_iface::VISION_MESSAGE, sizeof(VisionMessageHeader) + sizeof(ObstacleMessage) };
-
-
-  // loop over messages, sending one each iteration, and repeating once we reach the end of the list
-  for (int i = 0; /* loop forever */; i = (i+1)%messages.size())
+  // a surface with a pentagonal hull, which is created in the first frame and removed in the last one
+  float const normal[3] = { 0, 0, 1 };
+  std::vector<float> hull;
+  for (int i = 0; i < 5; i++)
   {
+    hull.push_back(1.0 + 0.5 * std::cos(i * 2 * M_PI / 5));
+    hull.push_back(0.5 * std::sin(i * 2 * M_PI / 5));
+    hull.push_back(0.1);
+  }
 
-    int sent = 0;
-    VisionMessage msg = messages[i];
-    char* buf = (char*)(&msg);
-
-    std::cout << std::endl << "Sending iface header: 0x" << std::hex << iface_header.id << std::dec 
-              << " length " << iface_header.len << std::endl;
-    std::cout << std::endl << "Sending message: " << msg << std::endl;
-
-    
-    // unsigned char* big_buf = new unsigned char[sizeof(iface_header) + sizeof(VisionMessageHeader) + msg.header.len];
-    // memcpy(big_buf, &iface_header, sizeof(iface_header));
-    // memcpy(big_buf + sizeof(iface_header), &msg.header, sizeof(VisionMessageHeader));
-    // memcpy(big_buf + sizeof(iface_header) + sizeof(VisionMessageHeader), msg.content, msg.header.len);
-
-    // sent = write(s, big_buf, sizeof(iface_header) + sizeof(VisionMessageHeader) + msg.header.len);
-    // if (sent <= 0)
-    //   failWithError("Failed to send big message!");
-    // if (verbose)
-    //   {
-    //     std::cout << "Sent " << sent << " bytes (everything)" << std::endl;
-    //   }
-    
-    // send the iface header
-    sent = socket_send(s, (char*)&iface_header, sizeof(am2b_iface::MsgHeader));
-    if (sent <= 0)
-      failWithError("Failed to send iface header!");
-
-    if (verbose)
+  // the updates of each frame
+  std::vector<VisionBatch> batches;
+  for (uint32_t frame = 1; frame <= 5; frame++)
+  {
+    uint64_t const timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    batches.push_back(VisionBatch(frame, timestamp));
+    for (auto const& obstacle : obstacles)
     {
-      std::cout << "Sent " << sent << " bytes (am2b_iface::MsgHeader)" << std::endl;
+      if (obstacle.first == frame)
+        batches.back().addObstacle(obstacle.second);
     }
-    
-     // send the header
-    sent = socket_send(s, buf, sizeof(VisionMessageHeader));
-    if (sent <= 0)
-      failWithError("Failed to send data!");
+    if (frame == 1)
+      batches.back().addSurface(am2b_iface::SET_SURFACE, 0, normal, hull.data(), hull.size() / 3);
+    if (frame == 5)
+      batches.back().addSurfaceRemoval(0);
+  }
+
+  // loop over the frames, sending one each iteration, and repeating once we reach the end of the list
+  for (int i = 0; /* loop forever */; i = (i+1)%batches.size())
+  {
+    VisionBatch const& batch = batches[i];
 
-    if (verbose)
+    if (protocol >= am2b_iface::VISION_PROTOCOL_V2)
     {
-      std::cout << "Sent " << sent << " bytes (message header)" << std::endl;
+      am2b_iface::MsgHeader iface_header = { am2b_iface::VISION_BATCH, batch.size() };
+      std::cout << std::endl << "Sending batch of frame #" << batch.header().frame
+                << " with " << batch.header().count << " records (" << batch.size() << " bytes)" << std::endl;
+      sendAll(s, (char*)&iface_header, sizeof(iface_header), "am2b_iface::MsgHeader", verbose);
+      sendAll(s, batch.data(), batch.size(), "batch", verbose);
     }
+    else
+    {
+      am2b_iface::toVisionMessages(batch, [s, verbose](VisionMessage const& msg) {
+        am2b_iface::MsgHeader iface_header = { am2b_iface::VISION_MESSAGE, (uint32_t)sizeof(VisionMessageHeader) + msg.header.len };
 
-     // send the message content
-    sent = socket_send(s, msg.content, msg.header.len);
-    if (sent <= 0)
-      failWithError("Failed to send data!");
+        std::cout << std::endl << "Sending iface header: 0x" << std::hex << iface_header.id << std::dec
+                  << " length " << iface_header.len << std::endl;
+        std::cout << std::endl << "Sending message: " << msg << std::endl;
 
-    if (verbose)
-    {
-      std::cout << "Sent " << sent << " bytes (message content)" << std::endl;
+        sendAll(s, (char*)&iface_header, sizeof(iface_header), "am2b_iface::MsgHeader", verbose);
+        sendAll(s, (char*)&msg.header, sizeof(VisionMessageHeader), "message header", verbose);
+        sendAll(s, msg.content, msg.header.len, "message content", verbose);
+      });
     }
 
     std::this_thread::sleep_for(std::chrono::milliseconds(1000)); /// TODO: This should be configurable from cmd line
@@ -260,7 +322,8 @@ int main(int argc, char* argv[])
 #endif
 
   int socket = connect(params.port, params.host_ip, params.verbose);
-  transmit(socket, params.verbose);
+  uint32_t const protocol = negotiate(socket, params.protocol, params.verbose);
+  transmit(socket, protocol, params.verbose);
   socket_close(socket);
 
 #ifdef _WIN32
@@ -10,6 +10,8 @@
 #include <tclap/CmdLine.h>
 #include <iface_msg.hpp>
 #include <iface_vision_msg.hpp>
+#include <iface_vision_cloud.hpp>
+#include <iface_vision_batch.hpp>
 
 using am2b_iface::VisionMessageHeader;
 using am2b_iface::Message_Type;
@@ -17,7 +19,11 @@ using am2b_iface::VisionMessage;
 using am2b_iface::ObstacleMessage;
 using am2b_iface::SurfaceMessage;
 using am2b_iface::PointCloudMessage;
+using am2b_iface::CompressedPointCloudMessage;
 using am2b_iface::RGBMessage;
+using am2b_iface::VisionBatchReader;
+using am2b_iface::VisionBatchHeader;
+using am2b_iface::SurfaceRecord;
 
 
 /**
@@ -25,7 +31,9 @@ using am2b_iface::RGBMessage;
  *
  * This server will listen on a given port for a TCP connection from LEPP,
  * and once connected will receive and decode VisionMessages containing
- * obstacles, surfaces, etc.
+ * obstacles, surfaces, etc. It answers the protocol negotiation with the
+ * given protocol version (or not at all for version 1, like older robots),
+ * and decodes the batches of version 2.
  *
  * This can be used to verify if data is being sent correctly, or as a reference
  * when implementing other components which need to receive VisionMessage data.
@@ -39,6 +47,7 @@ using am2b_iface::RGBMessage;
 struct ParsedParams
 {
   unsigned int port = 0; // port to listen on
+  unsigned int protocol = am2b_iface::VISION_PROTOCOL_V2; // highest protocol version to accept
   bool verbose = false;
 };
 
@@ -50,12 +59,15 @@ bool parse_args(int argc, char* argv[], ParsedParams* params)
 
     TCLAP::ValueArg<unsigned int> portArg("p","port","Port to listen on",true,0,"unsigned int");
     cmd.add( portArg );
+    TCLAP::ValueArg<unsigned int> protocolArg("","protocol","Highest vision protocol version to accept (default 2)",false,am2b_iface::VISION_PROTOCOL_V2,"unsigned int");
+    cmd.add( protocolArg );
     TCLAP::SwitchArg verboseSwitch("v","verbose","Verbose output", cmd, false);
 
     // Parse the argv array.
     cmd.parse( argc, argv );
     // Get the value parsed by each arg.
     params->port = portArg.getValue();
+    params->protocol = protocolArg.getValue();
     params->verbose = verboseSwitch.getValue();
 
   } catch (TCLAP::ArgException &e)  // catch any exceptions
@@ -82,7 +94,95 @@ void failWithError(std::string s)
   exit(1);
 }
 
-void readDataFrom(int socket_remote, const sockaddr_in& si_other, bool verbose)
+void printObstacle(ObstacleMessage const& message)
+{
+  std::cout << "Received obstacle: " << std::endl;
+  std::cout << message << std::endl;
+}
+
+void printSurface(SurfaceRecord const& surface, std::vector<float> const& vertices)
+{
+  std::cout << "Received Surface:" << std::endl;
+  std::cout << "\tid: " << surface.id << std::endl;
+  std::cout << "\taction: 0x" << std::hex << surface.action << std::dec << std::endl;
+  std::cout << "\tnormal: [" << surface.normal[0] << ", " << surface.normal[1] << ", " << surface.normal[2] << "]" << std::endl;
+  std::cout << "\tVertices (" << vertices.size() / 3 << "):" << std::endl;
+  for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+  {
+    std::cout << "\t\t[" << vertices[i] << ", " << vertices[i + 1] << ", " << vertices[i + 2] << "]" << std::endl;
+  }
+}
+
+// answers the protocol negotiation of the client, returns false if the connection died
+bool answerHello(int socket_remote, const char* data, unsigned int len, unsigned int protocol)
+{
+  if (len != sizeof(am2b_iface::VisionHello))
+  {
+    std::cout << "Received malformed VISION_HELLO (" << len << " bytes)" << std::endl;
+    return true;
+  }
+  am2b_iface::VisionHello const* offer = (am2b_iface::VisionHello const*)data;
+  std::cout << "Client offers vision protocol version " << offer->version << std::endl;
+  if (protocol <= am2b_iface::VISION_PROTOCOL_V1)
+  {
+    std::cout << "Not answering, the client will fall back to version 1" << std::endl;
+    return true;
+  }
+
+#pragma pack(push,1)
+  struct
+  {
+    am2b_iface::MsgHeader header;
+    am2b_iface::VisionHello hello;
+  } answer;
+#pragma pack(pop)
+  answer.header.id = am2b_iface::VISION_HELLO;
+  answer.header.len = sizeof(am2b_iface::VisionHello);
+  answer.hello.version = std::min(protocol, offer->version);
+  std::cout << "Using vision protocol version " << answer.hello.version << std::endl;
+  return socket_send(socket_remote, (char*)&answer, sizeof(answer)) == sizeof(answer);
+}
+
+void readBatch(const char* data, unsigned int len)
+{
+  VisionBatchReader reader(data, len);
+  if (!reader.valid())
+  {
+    std::cout << "Received malformed VISION_BATCH (" << len << " bytes)" << std::endl;
+    return;
+  }
+  VisionBatchHeader const& header = reader.header();
+  std::cout << "Received VisionBatch: [frame #" << header.frame << " | " << header.timestamp << " us | "
+            << header.count << " records | " << len << " bytes]" << std::endl;
+
+  std::vector<float> vertices;
+  while (reader.next())
+  {
+    switch (reader.type())
+    {
+      case Message_Type::Obstacle:
+      {
+        ObstacleMessage message;
+        if (reader.read(message))
+          printObstacle(message);
+        break;
+      }
+      case Message_Type::Surface:
+      {
+        SurfaceRecord surface;
+        if (reader.read(surface, vertices))
+          printSurface(surface, vertices);
+        break;
+      }
+      default:
+      {
+        std::cout << "UNKNOWN record type: " << reader.type() << "!!" << std::endl;
+      }
+    }
+  }
+}
+
+void readDataFrom(int socket_remote, const sockaddr_in& si_other, unsigned int protocol, bool verbose)
 {
   std::vector<char> buf;
   buf.resize(BUFLEN); // init buffer to be at least BUFLEN; we'll expand it later if need be
@@ -154,6 +254,19 @@ void readDataFrom(int socket_remote, const sockaddr_in& si_other, bool verbose)
       }
     }
 
+    if (iface_header->id == am2b_iface::VISION_HELLO)
+    {
+      if (!answerHello(socket_remote, buf.data() + iface_headerSize, iface_header->len, protocol))
+        return;
+      continue;
+    }
+
+    if (iface_header->id == am2b_iface::VISION_BATCH)
+    {
+      readBatch(buf.data() + iface_headerSize, iface_header->len);
+      continue;
+    }
+
     if (iface_header->id != am2b_iface::VISION_MESSAGE)
     {
       if (verbose)
@@ -171,24 +284,18 @@ void readDataFrom(int socket_remote, const sockaddr_in& si_other, bool verbose)
       case Message_Type::Obstacle:
       {
         ObstacleMessage* message = (ObstacleMessage*)(buf.data() + sizeof(VisionMessageHeader) + sizeof(am2b_iface::MsgHeader));
-        std::cout << "Received obstacle: " << std::endl;
-        std::cout << *message << std::endl;;
+        printObstacle(*message);
         break;
       }
       case Message_Type::Surface:
       {
         SurfaceMessage* message = (SurfaceMessage*)(buf.data() + sizeof(VisionMessageHeader) + sizeof(am2b_iface::MsgHeader));
-        std::cout << "Received Surface:" << std::endl;
-        std::cout << "\tid: " << message->id << std::endl;
-        std::cout << "\taction: 0x" << std::hex << message->action << std::dec << std::endl;
-        std::cout << "\tnormal: [" << message->normal[0] << ", " << message->normal[1] << ", " << message->normal[2] << "]" << std::endl;
-        std::cout << "\tVertices:" << std::endl;
-        for (int i = 0; i < 8; i++)
-        {
-          std::cout << "\t\t[";
-          std::cout << message->vertices[i*3] << ", " << message->vertices[i*3 + 1] << ", " << message->vertices[i*3 + 2];
-          std::cout << "]" << std::endl;
-        }
+        SurfaceRecord surface;
+        surface.id = message->id;
+        surface.action = message->action;
+        memcpy(surface.normal, message->normal, sizeof(surface.normal));
+        surface.vertex_count = 8;
+        printSurface(surface, std::vector<float>(message->vertices, message->vertices + 24));
         break;
       }
       case Message_Type::PointCloud:
@@ -199,6 +306,36 @@ void readDataFrom(int socket_remote, const sockaddr_in& si_other, bool verbose)
         std::cout << "\tSize of points:   " << message->format << " bytes" << std::endl;
         break;
       }
+      case Message_Type::CompressedPointCloud:
+      {
+        char const* content = buf.data() + sizeof(VisionMessageHeader) + sizeof(am2b_iface::MsgHeader);
+        // the content cannot extend beyond the received message
+        size_t const content_len = iface_header->len < sizeof(VisionMessageHeader) ? 0
+            : std::min<size_t>(header->len, iface_header->len - sizeof(VisionMessageHeader));
+        CompressedPointCloudMessage message;
+        std::vector<float> points;
+        std::cout << "Received compressed PointCloud:" << std::endl;
+        if (!am2b_iface::cloud_codec::decode(content, content_len, message, points))
+        {
+          std::cout << "\tFailed to decode the points!" << std::endl;
+          break;
+        }
+        std::cout << "\tNumber of points: " << message.count << std::endl;
+        std::cout << "\tCompressed size:  " << content_len - sizeof(CompressedPointCloudMessage) << " bytes" << std::endl;
+        if (message.count > 0)
+        {
+          float min[3] = { points[0], points[1], points[2] };
+          float max[3] = { points[0], points[1], points[2] };
+          for (size_t i = 0; i < points.size(); i++)
+          {
+            min[i % 3] = std::min(min[i % 3], points[i]);
+            max[i % 3] = std::max(max[i % 3], points[i]);
+          }
+          std::cout << "\tBounds: [" << min[0] << ", " << min[1] << ", " << min[2] << "] - ["
+                    << max[0] << ", " << max[1] << ", " << max[2] << "]" << std::endl;
+        }
+        break;
+      }
       case Message_Type::RGB_Image:
       {
         RGBMessage* message = (RGBMessage*)(buf.data() + sizeof(VisionMessageHeader) + sizeof(am2b_iface::MsgHeader));
@@ -216,7 +353,7 @@ void readDataFrom(int socket_remote, const sockaddr_in& si_other, bool verbose)
   }
 }
 
-void listen(unsigned int port, bool verbose)
+void listen(unsigned int port, unsigned int protocol, bool verbose)
 {
   struct sockaddr_in si_me, si_other;
   int s, s_other;
@@ -255,7 +392,7 @@ void listen(unsigned int port, bool verbose)
 
 
     // receive data from new connection
-    readDataFrom(s_other, si_other, verbose);
+    readDataFrom(s_other, si_other, protocol, verbose);
 
     std::cout << "Connection to client terminated!" << std::endl;
     std::cout << "-------------------------------------" << std::endl << std::endl;;
@@ -284,7 +421,7 @@ int main(int argc, char* argv[])
   }
 #endif
 
-  listen(params.port, params.verbose);
+  listen(params.port, params.protocol, params.verbose);
 
 #ifdef _WIN32
   if (WSACleanup() != 0)
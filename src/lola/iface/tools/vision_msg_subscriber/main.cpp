@@ -0,0 +1,260 @@
+#include<sockets_common.hpp>
+
+#include <sys/types.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <tclap/CmdLine.h>
+#include <iface_msg.hpp>
+#include <iface_vision_msg.hpp>
+#include <iface_vision_batch.hpp>
+#include <iface_vision_udp.hpp>
+
+using am2b_iface::VisionMessageHeader;
+using am2b_iface::Message_Type;
+using am2b_iface::ObstacleMessage;
+using am2b_iface::SurfaceRecord;
+using am2b_iface::VisionBatchReader;
+using am2b_iface::VisionDatagramAssembler;
+
+
+/**
+ * A tool for testing the UDP publishing of LEPP (see iface_vision_udp.hpp)
+ *
+ * This subscriber receives the datagrams published to a multicast group (or
+ * sent to this host) on a given port, reassembles the messages, and keeps
+ * track of the obstacles and surfaces. It starts with the first keyframe it
+ * receives, and whenever messages get lost, it waits for the next keyframe.
+ *
+ *
+**/
+
+// maximum size of a datagram
+#define BUFLEN 65536
+
+struct ParsedParams
+{
+  unsigned int port = 0; // port to listen on
+  std::string group;     // multicast group to join, if any
+  bool verbose = false;
+};
+
+
+bool parse_args(int argc, char* argv[], ParsedParams* params)
+{
+  try {
+    TCLAP::CmdLine cmd("Vision Message Subscriber", ' ', "0.4");
+
+    TCLAP::ValueArg<unsigned int> portArg("p","port","Port to listen on",true,0,"unsigned int");
+    cmd.add( portArg );
+    TCLAP::ValueArg<std::string> groupArg("g","group","Multicast group to join",false,"","string");
+    cmd.add( groupArg );
+    TCLAP::SwitchArg verboseSwitch("v","verbose","Verbose output", cmd, false);
+
+    // Parse the argv array.
+    cmd.parse( argc, argv );
+    // Get the value parsed by each arg.
+    params->port = portArg.getValue();
+    params->group = groupArg.getValue();
+    params->verbose = verboseSwitch.getValue();
+
+  } catch (TCLAP::ArgException &e)  // catch any exceptions
+  {
+     std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+     return false;
+   }
+  return true;
+}
+
+void failWithError(std::string s)
+{
+#ifdef _WIN32
+  LPWSTR *errstr = NULL;
+  FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                 NULL, WSAGetLastError(),
+                 MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+                 (LPWSTR)&s, 0, NULL);
+  std::cerr << s << errstr << std::endl;
+  LocalFree(errstr);
+#else
+  perror(s.c_str());
+#endif
+  exit(1);
+}
+
+/**
+ * The obstacle parts and surfaces known from the received batches.
+ */
+struct State
+{
+  std::set<std::pair<uint32_t, uint32_t> > obstacles;
+  std::set<uint32_t> surfaces;
+
+  void apply(VisionBatchReader& reader)
+  {
+    std::vector<float> vertices;
+    while (reader.next())
+    {
+      if (reader.type() == Message_Type::Obstacle)
+      {
+        ObstacleMessage obstacle;
+        if (!reader.read(obstacle))
+          continue;
+        if (obstacle.action == am2b_iface::REMOVE_SSV_WHOLE_SEGMENT)
+          obstacles.erase(obstacles.lower_bound(std::make_pair(obstacle.model_id, 0u)),
+                          obstacles.upper_bound(std::make_pair(obstacle.model_id, ~0u)));
+        else if (obstacle.action == am2b_iface::REMOVE_SSV_ONLY_PART)
+          obstacles.erase(std::make_pair(obstacle.model_id, obstacle.part_id));
+        else
+          obstacles.insert(std::make_pair(obstacle.model_id, obstacle.part_id));
+      }
+      else if (reader.type() == Message_Type::Surface)
+      {
+        SurfaceRecord surface;
+        if (!reader.read(surface, vertices))
+          continue;
+        if (surface.action == am2b_iface::REMOVE_SURFACE)
+          surfaces.erase(surface.id);
+        else
+          surfaces.insert(surface.id);
+      }
+    }
+  }
+};
+
+void subscribe(unsigned int port, std::string const& group, bool verbose)
+{
+  int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+#ifdef _WIN32
+  if ( s == INVALID_SOCKET)
+#else
+  if ( s == -1 )
+#endif
+    failWithError("creating socket failed!");
+
+  // allow several subscribers on the same host
+  int reuse = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse, sizeof(reuse));
+
+  struct sockaddr_in si_me;
+  memset(&si_me, 0, sizeof(si_me));
+  si_me.sin_family = AF_INET;
+  si_me.sin_port = htons(port);
+  si_me.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(s, (sockaddr*)&si_me, sizeof(si_me)) == -1)
+    failWithError("bind failed!");
+
+  if (!group.empty())
+  {
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr.s_addr = inet_addr(group.c_str());
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*)&mreq, sizeof(mreq)) != 0)
+      failWithError("joining the multicast group failed!");
+    std::cout << "Joined multicast group " << group << std::endl;
+  }
+  std::cout << "Listening on port " << port << "..." << std::endl;
+
+  std::vector<char> buf(BUFLEN);
+  VisionDatagramAssembler assembler;
+  State state;
+  bool synced = false;
+  uint32_t lost = 0;
+
+  while (1)
+  {
+    int recvd = recv(s, buf.data(), buf.size(), 0);
+    if (recvd < 0)
+      failWithError("recv() failed!");
+    if (!assembler.add(buf.data(), recvd))
+      continue;
+
+    if (assembler.lost() != lost)
+    {
+      std::cout << "Lost " << assembler.lost() - lost << " message(s)";
+      if (synced)
+        std::cout << ", waiting for the next keyframe";
+      std::cout << std::endl;
+      lost = assembler.lost();
+      synced = false;
+    }
+
+    std::vector<char> const& message = assembler.message();
+    am2b_iface::MsgHeader const* header = (am2b_iface::MsgHeader const*)message.data();
+    const char* content = message.data() + sizeof(am2b_iface::MsgHeader);
+    if (message.size() < sizeof(am2b_iface::MsgHeader) || header->len != message.size() - sizeof(am2b_iface::MsgHeader))
+    {
+      std::cout << "Received malformed message #" << assembler.sequence() << std::endl;
+      continue;
+    }
+
+    if (header->id == am2b_iface::VISION_BATCH)
+    {
+      VisionBatchReader reader(content, header->len);
+      if (!reader.valid())
+      {
+        std::cout << "Received malformed batch #" << assembler.sequence() << std::endl;
+        continue;
+      }
+      if (assembler.keyframe())
+      {
+        state = State();
+        synced = true;
+      }
+      else if (!synced)
+      {
+        if (verbose)
+          std::cout << "Skipping batch #" << assembler.sequence() << " (waiting for a keyframe)" << std::endl;
+        continue;
+      }
+      state.apply(reader);
+      std::cout << "#" << assembler.sequence() << (assembler.keyframe() ? " keyframe" : " batch")
+                << " of frame " << reader.header().frame << " (" << reader.header().count << " records): "
+                << state.obstacles.size() << " obstacle parts, " << state.surfaces.size() << " surfaces" << std::endl;
+    }
+    else if (header->id == am2b_iface::VISION_MESSAGE)
+    {
+      VisionMessageHeader const* vision_header = (VisionMessageHeader const*)content;
+      std::cout << "#" << assembler.sequence() << " " << *vision_header << std::endl;
+    }
+    else if (verbose)
+    {
+      std::cout << "Received message of type: 0x" << std::hex << header->id << std::dec << std::endl;
+    }
+  }
+
+  socket_close(s);
+}
+
+int main(int argc, char* argv[])
+{
+  ParsedParams params;
+  if (!parse_args(argc, argv, &params))
+  {
+    return 0;
+  }
+
+#ifdef _WIN32 // must init WinSock before using sockets on Windows
+  WSADATA wsaData = { 0 };
+  int res = WSAStartup(MAKEWORD(2, 2), &wsaData);
+  if (res != 0)
+  {
+      std::cerr << "Could not init Winsock!" << std::endl;
+      LogWSAErrorStr(res);
+      return -1;
+  }
+#endif
+
+  subscribe(params.port, params.group, params.verbose);
+
+#ifdef _WIN32
+  if (WSACleanup() != 0)
+      failWithError("Failed to shut down Winsock cleanly");
+#endif
+
+  return 0;
+}
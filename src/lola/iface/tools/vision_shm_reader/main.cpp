@@ -0,0 +1,155 @@
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <tclap/CmdLine.h>
+#include <iface_msg.hpp>
+#include <iface_vision_msg.hpp>
+#include <iface_vision_batch.hpp>
+#include <iface_vision_shm.hpp>
+
+using am2b_iface::VisionMessageHeader;
+using am2b_iface::VisionBatchReader;
+using am2b_iface::VisionShmReader;
+
+
+/**
+ * A tool for testing the shared memory transport of LEPP (see iface_vision_shm.hpp)
+ *
+ * This reader attaches to the shared memory buffer that LEPP writes the vision
+ * messages to (waiting for it to be created), and prints every message along
+ * with the time it took from writing to reading it. With --stats, only a
+ * summary is printed every second.
+ *
+ *
+**/
+
+struct ParsedParams
+{
+  std::string name;   // name of the shared memory object
+  bool stats = false;
+};
+
+
+bool parse_args(int argc, char* argv[], ParsedParams* params)
+{
+  try {
+    TCLAP::CmdLine cmd("Vision Message Shared Memory Reader", ' ', "0.4");
+
+    TCLAP::ValueArg<std::string> nameArg("n","name","Name of the shared memory object",false,"/lepp3_vision","string");
+    cmd.add( nameArg );
+    TCLAP::SwitchArg statsSwitch("s","stats","Only print statistics every second", cmd, false);
+
+    // Parse the argv array.
+    cmd.parse( argc, argv );
+    // Get the value parsed by each arg.
+    params->name = nameArg.getValue();
+    params->stats = statsSwitch.getValue();
+
+  } catch (TCLAP::ArgException &e)  // catch any exceptions
+  {
+     std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+     return false;
+   }
+  return true;
+}
+
+void printMessage(VisionShmReader const& reader, std::vector<char> const& message)
+{
+  am2b_iface::MsgHeader const* header = (am2b_iface::MsgHeader const*)message.data();
+  const char* content = message.data() + sizeof(am2b_iface::MsgHeader);
+  std::cout << "#" << reader.sequence() << " after " << reader.latency() / 1000.0 << " us: ";
+  if (message.size() < sizeof(am2b_iface::MsgHeader) || header->len != message.size() - sizeof(am2b_iface::MsgHeader))
+  {
+    std::cout << "malformed message" << std::endl;
+  }
+  else if (header->id == am2b_iface::VISION_BATCH)
+  {
+    VisionBatchReader batch(content, header->len);
+    if (batch.valid())
+      std::cout << (reader.keyframe() ? "keyframe" : "batch") << " of frame " << batch.header().frame << " (" << batch.header().count << " records)" << std::endl;
+    else
+      std::cout << "malformed batch" << std::endl;
+  }
+  else if (header->id == am2b_iface::VISION_MESSAGE)
+  {
+    std::cout << *(VisionMessageHeader const*)content << std::endl;
+  }
+  else
+  {
+    std::cout << "message of type 0x" << std::hex << header->id << std::dec << std::endl;
+  }
+}
+
+void read(std::string const& name, bool stats)
+{
+  VisionShmReader reader;
+  std::cout << "Waiting for " << name << "..." << std::endl;
+  while (!reader.open(name))
+    usleep(100000);
+  std::cout << "Reading from " << name << std::endl;
+
+  std::vector<char> message;
+  uint32_t lost = 0;
+  size_t count = 0;
+  size_t bytes = 0;
+  uint64_t latency_sum = 0;
+  uint64_t latency_max = 0;
+  uint64_t last = am2b_iface::shm_detail::now();
+  while (1)
+  {
+    if (reader.read(message, 1000))
+    {
+      if (reader.lost() != lost)
+      {
+        std::cout << "Lost " << reader.lost() - lost << " message(s)" << std::endl;
+        lost = reader.lost();
+      }
+      if (!stats)
+        printMessage(reader, message);
+      ++count;
+      bytes += message.size();
+      latency_sum += reader.latency();
+      latency_max = std::max(latency_max, reader.latency());
+    }
+    else if (reader.replaced())
+    {
+      std::cout << name << " was replaced, reopening" << std::endl;
+      while (!reader.open(name))
+        usleep(100000);
+      lost = 0;
+      continue;
+    }
+    else if (!stats)
+    {
+      continue;
+    }
+
+    uint64_t const now = am2b_iface::shm_detail::now();
+    if (stats && now - last >= 1000000000ull)
+    {
+      std::cout << count << " messages, " << bytes / 1024 << " kB, latency mean "
+                << (count ? latency_sum / count / 1000.0 : 0) << " us, max "
+                << latency_max / 1000.0 << " us, " << lost << " lost" << std::endl;
+      count = bytes = 0;
+      latency_sum = latency_max = 0;
+      last = now;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  ParsedParams params;
+  if (!parse_args(argc, argv, &params))
+  {
+    return 0;
+  }
+
+  read(params.name, params.stats);
+
+  return 0;
+}
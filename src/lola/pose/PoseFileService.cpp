@@ -42,6 +42,6 @@ std::shared_ptr<HR_Pose_Red> PoseFileService::getCurrentPose() const {
   return pose_data_[idx];
 }
 
-void PoseFileService::triggerNextFrame() {
+void PoseFileService::triggerNextFrame(double timestamp) {
   ++pose_idx_;
 }
@@ -23,9 +23,10 @@ public:
   std::shared_ptr<HR_Pose_Red> getCurrentPose() const override;
 
   /**
-   * Dispatches the next frame
+   * Dispatches the next frame. The saved poses belong to the frames
+   * one by one, so the timestamp is not needed.
    */
-  void triggerNextFrame() override;
+  void triggerNextFrame(double timestamp) override;
 
 private:
 
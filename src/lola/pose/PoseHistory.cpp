@@ -0,0 +1,110 @@
+#include "PoseHistory.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <Eigen/Geometry>
+
+namespace {
+typedef Eigen::Map<Eigen::Matrix<float, 3, 3, Eigen::RowMajor>> RotationMap;
+typedef Eigen::Map<Eigen::Matrix<float, 3, 3, Eigen::RowMajor> const> ConstRotationMap;
+
+void lerp(float const* a, float const* b, float alpha, float* out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = a[i] + alpha * (b[i] - a[i]);
+  }
+}
+
+void slerp(float const* a, float const* b, float alpha, float* out) {
+  Eigen::Quaternionf const qa = Eigen::Quaternionf(Eigen::Matrix3f(ConstRotationMap(a)));
+  Eigen::Quaternionf const qb = Eigen::Quaternionf(Eigen::Matrix3f(ConstRotationMap(b)));
+  RotationMap rotation(out);
+  rotation = qa.slerp(alpha, qb).toRotationMatrix();
+}
+}
+
+PoseHistory::PoseHistory() : head_(0) {
+  for (Slot& slot : slots_) {
+    slot.sequence.store(0, std::memory_order_relaxed);
+  }
+}
+
+void PoseHistory::push(HR_Pose_Red const& pose, double time) {
+  uint64_t const index = head_.load(std::memory_order_relaxed);
+  Slot& slot = slots_[index % CAPACITY];
+
+  uint32_t const sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.entry.index = index;
+  slot.entry.time = time;
+  memcpy(&slot.entry.pose, &pose, sizeof(pose));
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+
+  head_.store(index + 1, std::memory_order_release);
+}
+
+bool PoseHistory::read(uint64_t index, Entry& entry) const {
+  Slot const& slot = slots_[index % CAPACITY];
+  for (;;) {
+    uint32_t const before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    memcpy(&entry, &slot.entry, sizeof(entry));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == before) {
+      return entry.index == index;
+    }
+  }
+}
+
+bool PoseHistory::at(double time, HR_Pose_Red& pose) const {
+  uint64_t const head = head_.load(std::memory_order_acquire);
+  if (head == 0) {
+    return false;
+  }
+
+  // Search backwards from the newest pose, since frames are usually looked
+  // up shortly after they were captured.
+  Entry newer;
+  Entry older;
+  if (!read(head - 1, newer)) {
+    return false;
+  }
+  uint64_t const oldest = head > CAPACITY ? head - CAPACITY : 0;
+  for (uint64_t i = head - 1; newer.time > time && i > oldest; --i) {
+    if (!read(i - 1, older)) {
+      // overwritten while searching, so this is about as old as it gets
+      break;
+    }
+    if (older.time <= time) {
+      double const span = newer.time - older.time;
+      interpolate(older.pose, newer.pose, span > 0 ? (time - older.time) / span : 1, pose);
+      return true;
+    }
+    newer = older;
+  }
+
+  memcpy(&pose, &newer.pose, sizeof(pose));
+  return true;
+}
+
+void PoseHistory::interpolate(HR_Pose_Red const& a, HR_Pose_Red const& b,
+                              double alpha, HR_Pose_Red& pose) {
+  float const f = static_cast<float>(alpha);
+  memcpy(&pose, alpha < 0.5 ? &a : &b, sizeof(pose));
+
+  pose.stamp = a.stamp + static_cast<int64_t>(std::round(alpha * static_cast<double>(
+      static_cast<int64_t>(b.stamp - a.stamp))));
+  lerp(a.t_wr_cl, b.t_wr_cl, f, pose.t_wr_cl, 3);
+  slerp(a.R_wr_cl, b.R_wr_cl, f, pose.R_wr_cl);
+  lerp(a.t_wr_ub, b.t_wr_ub, f, pose.t_wr_ub, 3);
+  slerp(a.R_wr_ub, b.R_wr_ub, f, pose.R_wr_ub);
+
+  if (a.stance == b.stance) {
+    lerp(a.t_stance_odo, b.t_stance_odo, f, pose.t_stance_odo, 3);
+    // the shorter way around
+    float const dphi = std::remainder(b.phi_z_odo - a.phi_z_odo, static_cast<float>(2 * M_PI));
+    pose.phi_z_odo = std::remainder(a.phi_z_odo + f * dphi, static_cast<float>(2 * M_PI));
+  }
+}
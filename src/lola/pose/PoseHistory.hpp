@@ -0,0 +1,75 @@
+#ifndef LOLA_POSE_HISTORY_H__
+#define LOLA_POSE_HISTORY_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iface_vis.h>
+
+/**
+ * The most recently received poses, each with the (local) time it belongs to,
+ * from which the pose at any time in between can be interpolated.
+ *
+ * The poses are kept in a fixed size ring buffer that a single thread writes
+ * to, while any number of threads read from it, without locks: every slot is
+ * guarded by a sequence number that is odd while the slot is being written,
+ * so that readers retry torn reads, and holds the number of the pose it
+ * contains, so that readers notice when it was overwritten in the meantime.
+ */
+class PoseHistory {
+public:
+  /**
+   * The number of poses kept.
+   */
+  static size_t const CAPACITY = 1024;
+
+  PoseHistory();
+
+  /**
+   * Adds a pose that belongs to the given time (s). Times must not decrease.
+   * Must only be called from a single thread.
+   */
+  void push(HR_Pose_Red const& pose, double time);
+
+  /**
+   * Obtains the pose at the given time (s), interpolated between the two
+   * poses around it. Times before the oldest or after the newest pose give
+   * that pose. Returns false if there are no poses yet.
+   */
+  bool at(double time, HR_Pose_Red& pose) const;
+
+  /**
+   * Interpolates between the poses `a` and `b`, with `alpha` going from 0
+   * (`a`) to 1 (`b`): the positions linearly and the rotations with SLERP.
+   * The odometry is only interpolated if both poses share the stance leg,
+   * since it jumps when the stance leg changes. All other fields are taken
+   * from the closer pose.
+   */
+  static void interpolate(HR_Pose_Red const& a, HR_Pose_Red const& b,
+                          double alpha, HR_Pose_Red& pose);
+
+private:
+  struct Entry {
+    uint64_t index;
+    double time;
+    HR_Pose_Red pose;
+  };
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    Entry entry;
+  };
+
+  /**
+   * Copies the entry of the pose with the given number. Returns false if it
+   * was overwritten already.
+   */
+  bool read(uint64_t index, Entry& entry) const;
+
+  Slot slots_[CAPACITY];
+  /**
+   * The number of poses pushed so far.
+   */
+  std::atomic<uint64_t> head_;
+};
+
+#endif
@@ -1,8 +1,23 @@
 #include "PoseUdpService.hpp"
+#include <algorithm>
+#include <chrono>
 #include <thread>
 #include <boost/bind.hpp>
 #include "deps/easylogging++.h"
 
+namespace {
+/**
+ * The largest drift between the clocks of the video source and the local one
+ * that the offset estimate follows (s/s).
+ */
+double const MAX_CLOCK_DRIFT = 1e-4;
+/**
+ * Frames that seem to take longer than this to arrive (s) mean that the clock
+ * of the video source jumped, so the offset is estimated anew.
+ */
+double const CLOCK_JUMP = 1.0;
+}
+
 PoseUdpService::~PoseUdpService() {
   io_service_.stop();
 }
@@ -19,39 +34,38 @@ void PoseUdpService::read_handler(
     return;
   }
 
-  std::shared_ptr<HR_Pose_Red> new_pose(new HR_Pose_Red);
+  HR_Pose_Red new_pose;
   // The copy is thread safe since nothing can be writing to the recv_buffer
   // at this point. No new async read is queued until this callback is complete.
-  memcpy(new_pose.get(), recv_buffer_.data(), sizeof(HR_Pose_Red));
-  // This performs an atomic update of the pointer, making it a lock-free,
-  // thread-safe operation
-  received_pose_ = new_pose;
+  memcpy(&new_pose, recv_buffer_.data(), sizeof(HR_Pose_Red));
+  // The history is lock-free; this is the only thread that writes to it.
+  history_.push(new_pose, now());
   // notify any TFObserver of the new pose
 
   // Print parameters received
 /*  LTRACE << "Received pose"
-         << "  Phi_Z_ODO = " << new_pose->phi_z_odo
-         << "  Stamp = " << new_pose->stamp
-         << "  T_Stance_ODO.X = " << new_pose->t_stance_odo[0]
-         << "  T_Stance_ODO.Y = " << new_pose->t_stance_odo[1]
-         << "  T_Stance_ODO.Z = " << new_pose->t_stance_odo[2]
-         << "  Version Nr. = " << new_pose->version
-         << "  TIC counter = " << new_pose->tick_counter
-         << "  Stance = " << static_cast<int>(new_pose->stance)
+         << "  Phi_Z_ODO = " << new_pose.phi_z_odo
+         << "  Stamp = " << new_pose.stamp
+         << "  T_Stance_ODO.X = " << new_pose.t_stance_odo[0]
+         << "  T_Stance_ODO.Y = " << new_pose.t_stance_odo[1]
+         << "  T_Stance_ODO.Z = " << new_pose.t_stance_odo[2]
+         << "  Version Nr. = " << new_pose.version
+         << "  TIC counter = " << new_pose.tick_counter
+         << "  Stance = " << static_cast<int>(new_pose.stance)
          << "  Size of HR_Pose = " << sizeof(HR_Pose_Red)
          << "  Size of Message = " << bytes_transferred
-         << "  Translation.X= " << new_pose->t_wr_cl[0]
-         << "  Translation.Y= " << new_pose->t_wr_cl[1]
-         << "  Translation.Z= " << new_pose->t_wr_cl[2]
-         << "  Rotation[0 0]= " << new_pose->R_wr_cl[0]
-         << "  Rotation[0 1]= " << new_pose->R_wr_cl[1]
-         << "  Rotation[0 2]= " << new_pose->R_wr_cl[2]
-         << "  Rotation[1 0]= " << new_pose->R_wr_cl[3]
-         << "  Rotation[1 1]= " << new_pose->R_wr_cl[4]
-         << "  Rotation[1 2]= " << new_pose->R_wr_cl[5]
-         << "  Rotation[2 0]= " << new_pose->R_wr_cl[6]
-         << "  Rotation[2 1]= " << new_pose->R_wr_cl[7]
-         << "  Rotation[2 2]= " << new_pose->R_wr_cl[8];
+         << "  Translation.X= " << new_pose.t_wr_cl[0]
+         << "  Translation.Y= " << new_pose.t_wr_cl[1]
+         << "  Translation.Z= " << new_pose.t_wr_cl[2]
+         << "  Rotation[0 0]= " << new_pose.R_wr_cl[0]
+         << "  Rotation[0 1]= " << new_pose.R_wr_cl[1]
+         << "  Rotation[0 2]= " << new_pose.R_wr_cl[2]
+         << "  Rotation[1 0]= " << new_pose.R_wr_cl[3]
+         << "  Rotation[1 1]= " << new_pose.R_wr_cl[4]
+         << "  Rotation[1 2]= " << new_pose.R_wr_cl[5]
+         << "  Rotation[2 0]= " << new_pose.R_wr_cl[6]
+         << "  Rotation[2 1]= " << new_pose.R_wr_cl[7]
+         << "  Rotation[2 2]= " << new_pose.R_wr_cl[8];
 */
   queue_recv();
 }
@@ -84,6 +98,27 @@ void PoseUdpService::start() {
   t.detach();
 }
 
-void PoseUdpService::triggerNextFrame() {
-  pose_.swap(received_pose_);
+double PoseUdpService::now() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PoseUdpService::triggerNextFrame(double timestamp) {
+  double const arrival = now();
+  double capture = arrival;
+  if (timestamp > 0) {
+    double const delay = arrival - timestamp;
+    if (last_arrival_ == 0 || delay > clock_offset_ + CLOCK_JUMP) {
+      clock_offset_ = delay;
+    } else {
+      clock_offset_ = std::min(delay, clock_offset_ + MAX_CLOCK_DRIFT * (arrival - last_arrival_));
+    }
+    last_arrival_ = arrival;
+    capture = timestamp + clock_offset_;
+  }
+
+  HR_Pose_Red pose;
+  if (history_.at(capture - latency_, pose)) {
+    pose_ = std::make_shared<HR_Pose_Red>(pose);
+  }
 }
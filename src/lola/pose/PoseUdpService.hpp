@@ -2,6 +2,7 @@
 #define LOLA_POSE_UDP_SERVICE_H__
 
 #include "lepp3/pose/PoseService.hpp"
+#include "lola/pose/PoseHistory.hpp"
 #include <cstdint>
 #include <iface_vis.h>
 #include <memory>
@@ -14,6 +15,14 @@
  * LOLA pose messages on a particular UDP port. It provides an API for other
  * components to get the current pose information, without worrying about running
  * the networking communication infrastructure or threading.
+ *
+ * The received poses are kept for a while, stamped with their time of
+ * arrival, so that every frame gets the pose interpolated at the time it was
+ * captured, rather than the last one that arrived. Since the video source
+ * timestamps frames with its own clock, the offset to the local clock is
+ * estimated as the smallest observed delay between the capture and the
+ * arrival of the frames. The remaining constant difference between the
+ * latency of the frames and that of the poses is configured.
  */
 class PoseUdpService : public lepp::PoseService {
 public:
@@ -21,11 +30,18 @@ public:
    * Create a new `PoseService` that will listen on the given local (UDP) socket
    * for new pose messages coming from the robot. It does not need to know the
    * network address of the robot itself.
+   *
+   * `latency` (ms) is how much longer frames take to arrive than the poses of
+   * the same instant, with the fastest frames; poses are looked up this much
+   * earlier. It can be negative.
    */
-  PoseUdpService(std::string const &host, uint16_t port)
+  PoseUdpService(std::string const &host, uint16_t port, int latency = 0)
       : host_(host),
         port_(port),
-        socket_(io_service_) {}
+        latency_(latency / 1000.0),
+        socket_(io_service_),
+        clock_offset_(0),
+        last_arrival_(0) {}
 
   virtual ~PoseUdpService();
 
@@ -62,9 +78,10 @@ public:
   }
 
   /**
-   * Dispatches the next frame
+   * Dispatches the next frame, taking the pose at the time it was captured.
+   * Without a timestamp, the frame is taken to be captured now.
    */
-  void triggerNextFrame() override;
+  void triggerNextFrame(double timestamp) override;
 
 private:
   /**
@@ -92,6 +109,11 @@ private:
    */
   void queue_recv();
 
+  /**
+   * The current time of the local clock (s).
+   */
+  static double now();
+
   /**
    * The local host on which the service will listen.
    */
@@ -100,6 +122,10 @@ private:
    * The port number where the service will listen.
    */
   uint16_t const port_;
+  /**
+   * How much later frames arrive than the poses of the same instant (s).
+   */
+  double const latency_;
 
   /**
    * The IO service that will handle the async reads and callback invocation.
@@ -116,9 +142,17 @@ private:
   boost::array<char, sizeof(HR_Pose_Red)> recv_buffer_;
 
   /**
-   * The last post received by the ncetwork socket
+   * The poses received by the network socket, stamped with the time of their
+   * arrival.
+   */
+  PoseHistory history_;
+
+  /**
+   * The estimated offset from the clock of the video source to the local
+   * clock (s), and the arrival time of the last frame.
    */
-  std::shared_ptr<HR_Pose_Red> received_pose_;
+  double clock_offset_;
+  double last_arrival_;
 
   /**
    * The current pose data. This is always syncronous